@@ -21,7 +21,7 @@ namespace f5 {
 
 
             using checker = std::function<validation::result(
-                    u8view rule, value part, validation::annotations)>;
+                    const compiled::rule &, validation::annotations)>;
 
 
             extern const checker additional_properties_checker, always,
@@ -0,0 +1,47 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+#include <fost/core>
+
+
+namespace f5 {
+
+
+    namespace json {
+
+
+        /// A read only memory mapping of the whole of a file. The pages
+        /// are read in as they are used, and the kernel is told that they
+        /// will be read from the start to the end.
+        class mapped_file {
+            int fd = -1;
+            std::size_t bytes = 0;
+            void *base = nullptr;
+
+          public:
+            /// Throws if the file can't be opened or mapped
+            explicit mapped_file(const boost::filesystem::path &);
+            ~mapped_file();
+
+            mapped_file(const mapped_file &) = delete;
+            mapped_file &operator=(const mapped_file &) = delete;
+
+            const char *begin() const {
+                return static_cast<const char *>(base);
+            }
+            const char *end() const { return begin() + bytes; }
+            std::size_t size() const { return bytes; }
+        };
+
+
+    }
+
+
+}
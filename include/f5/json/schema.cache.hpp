@@ -17,14 +17,23 @@ namespace f5 {
     namespace json {
 
 
+        /// The schemas to load into the root cache. Either a single
+        /// entry or an array of them, where each is a file, a directory
+        /// (all of the `.json` files in it and its sub-directories) or a
+        /// glob pattern.
         extern const fostlib::setting<value> c_schema_path;
 
 
         class schema_cache {
-            friend validation::annotations;
+            friend validation::scope;
 
             std::shared_ptr<schema_cache> base;
+            std::shared_ptr<const schema_cache> index;
             std::map<fostlib::string, schema> cache;
+            std::map<const compiled::node *, const schema *> nodes;
+
+            /// Look in this cache and its index, but not its bases
+            const schema *find(f5::u8view) const;
 
           public:
             /// Create an empty cache which uses the root cache
@@ -32,22 +41,86 @@ namespace f5 {
             schema_cache();
             /// Create a cache which is built on top of another cache
             schema_cache(std::shared_ptr<schema_cache>);
+            /// Create a cache which is built on top of another cache and
+            /// which also shares the (read only) entries of an index
+            schema_cache(
+                    std::shared_ptr<schema_cache>,
+                    std::shared_ptr<const schema_cache>);
 
             /// Perform a lookup in this case and its bases
             const schema &operator[](f5::u8view) const;
+            /// Return the schema that was inserted for a compiled node,
+            /// looking in this cache and its bases. Returns `nullptr` if
+            /// there is none.
+            const schema *find(const compiled::node &) const;
 
             /// The root cache. The root cache is the only cache which
             /// should have an empty base.
             static std::shared_ptr<schema_cache> root_cache();
 
+            /// True if nothing has been inserted into this cache. Its
+            /// base and index may still contain entries.
+            bool empty() const { return cache.empty(); }
+
             /// Add a schema at a given position in the cache
             const schema &insert(fostlib::string, schema);
             /// Add a schema at an unnamed position, i.e. only if it
             /// contains a `$id` describing its proper location
             const schema &insert(schema);
+
+            /// The names and schemas in this cache, but not in its bases
+            /// or index
+            std::vector<std::pair<fostlib::string, const schema *>>
+                    entries() const;
+
+            /// The schemas that the schema loaders have loaded so far,
+            /// together with the URL each was loaded for
+            static std::vector<std::pair<fostlib::string, const schema *>>
+                    loaded();
+            /// Record a schema as if the schema loaders had loaded it for
+            /// the URL. If a schema has already been loaded for the URL
+            /// then that one is kept and returned instead.
+            static const schema &add_loaded(fostlib::string, schema);
+        };
+
+
+        /// The outcome of `prefetch`
+        struct prefetched {
+            /// The URLs of the schemas that are now available
+            std::vector<fostlib::string> schemas;
+            /// The references that could not be resolved, together with
+            /// the reason why
+            std::vector<std::pair<fostlib::string, fostlib::string>>
+                    unresolved;
         };
 
 
+        /// Find every `$ref` to another schema that can be reached from
+        /// this one and load them, and everything they refer to, ahead of
+        /// time. The schemas at each level are loaded in parallel using
+        /// up to `threads` threads (zero means one for each schema, up to
+        /// a limit, as the time is mostly spent waiting for I/O).
+        /// Once this returns, validation will not need to wait for any of
+        /// the schema loaders.
+        prefetched prefetch(const schema &, std::size_t threads = 0);
+
+
+        /// Write the JSON of the schemas in the root cache, and of those
+        /// loaded by the schema loaders, to a binary archive file. Returns
+        /// the number of schemas written.
+        std::size_t save_schema_archive(const boost::filesystem::path &);
+        /// Read an archive written by `save_schema_archive`. Its schemas
+        /// are recorded as loaded, so the schema loaders are never asked
+        /// for them. Returns the number of schemas read.
+        ///
+        /// This saves fetching and parsing the schemas, but each one is
+        /// still compiled again and nothing is shared with other processes
+        /// that read the same file. An archive from a different version of
+        /// the file format (or a machine with a different byte order) is
+        /// rejected, as is one that is corrupt.
+        std::size_t load_schema_archive(const boost::filesystem::path &);
+
+
     }
 
 
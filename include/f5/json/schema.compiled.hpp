@@ -0,0 +1,379 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+#include <f5/json/assertions.hpp>
+#include <fost/url>
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace f5 {
+
+
+    namespace json {
+
+
+        namespace compiled {
+
+
+            /// The keywords that the compiled graph knows about, in the
+            /// same (byte) order as their names. Anything else found in a
+            /// schema object (`title`, `description`, `$comment` etc.)
+            /// only annotates it and is left out of the graph.
+            enum class keyword : std::uint8_t {
+                additional_items,
+                additional_properties,
+                all_of,
+                any_of,
+                const_,
+                contains,
+                definitions,
+                dependencies,
+                else_,
+                enum_,
+                exclusive_maximum,
+                exclusive_minimum,
+                if_,
+                items,
+                max_items,
+                max_length,
+                max_properties,
+                maximum,
+                min_items,
+                min_length,
+                min_properties,
+                minimum,
+                multiple_of,
+                not_,
+                one_of,
+                pattern,
+                pattern_properties,
+                properties,
+                property_names,
+                required,
+                then,
+                type,
+                unique_items
+            };
+            constexpr std::size_t keyword_count =
+                    std::size_t(keyword::unique_items) + 1;
+
+            /// Return the keyword with this name, if there is one
+            std::optional<keyword> find_keyword(u8view);
+
+
+            /**
+             * ## Branch selection
+             *
+             * Works out which of the sub-schemas of an `anyOf` or `oneOf`
+             * might match a value without applying any of them. Branches
+             * are ruled out by the JSON types that they accept and, for
+             * objects, by a discriminator. This is a property that every
+             * branch accepting objects gives a `const` or `enum` for (for
+             * example a `"type"` property), so only the branches that allow
+             * the value the object has need to be tried.
+             *
+             * The branches are often `$ref`s, which can only be followed
+             * once the whole graph has been compiled, so this is worked out
+             * the first time it is needed.
+             */
+            class branches {
+                std::once_flag once;
+                /// The branches to try for a value of each JSON type
+                std::array<std::vector<std::size_t>, 7> by_type;
+                /// The discriminating property, if there is one
+                std::optional<fostlib::string> property;
+                /// For each value of the property, keyed by its `hash`, the
+                /// branches to try
+                std::unordered_multimap<
+                        std::size_t,
+                        std::pair<value, std::vector<std::size_t>>>
+                        by_value;
+                /// The branches to try for an object that doesn't have the
+                /// property
+                std::vector<std::size_t> without;
+
+                void build(const rule &);
+
+              public:
+                /// The indexes of the rule's `subschemas` that could match
+                /// the value, in order
+                const std::vector<std::size_t> &
+                        candidates(const rule &, const value &);
+            };
+
+
+            /**
+             * ## Compiled rule
+             *
+             * A single keyword found in a schema object together with its
+             * argument and links to any sub-schemas the argument contains.
+             */
+            struct rule {
+                /// The keyword, e.g. `properties`
+                u8view name;
+                keyword id;
+                /// The keyword's argument as found in the schema
+                value part;
+                /// The location of the keyword in the schema
+                pointer spos;
+                /// The assertion to run. This is `nullptr` for keywords
+                /// that are only used by their siblings, e.g. `then`
+                const assertion::checker *check = nullptr;
+
+                /// For keywords that take a single sub-schema
+                const node *subschema = nullptr;
+                /// For keywords that take an array of sub-schemas
+                std::vector<const node *> subschemas;
+                /// For keywords that take an object whose values are
+                /// sub-schemas
+                std::vector<std::pair<fostlib::string, const node *>> named;
+
+                /// The regular expressions for `pattern` (a single entry),
+                /// or `patternProperties` (one for each entry in `named`).
+                /// An entry is empty if the pattern failed to compile.
+                std::vector<std::optional<std::regex>> patterns;
+
+                /// The allowed values for `enum` and `const` keyed by their
+                /// `hash`. A value only needs to be compared with those
+                /// that have the same hash, which also means it is never
+                /// compared with values of another type.
+                std::unordered_multimap<std::size_t, value> values;
+
+                /// Return `true` if the value is one of the `values`
+                bool allows(const value &) const;
+
+                /// For `anyOf` and `oneOf`, which of the `subschemas` need to
+                /// be tried for a value
+                std::unique_ptr<branches> choices;
+
+                /// Set for the object keywords that are checked together
+                /// by the node's `object_rules` rather than by `check`
+                bool fused = false;
+            };
+
+
+            /**
+             * ## Object rules
+             *
+             * The keywords of a node that look at the members of an object
+             * (`properties`, `patternProperties`, `additionalProperties`,
+             * `propertyNames`, `required` and `dependencies`) compiled
+             * together so that the members are walked only once. Each
+             * member name is looked up in a single table that says which
+             * sub-schema applies to it, what it depends on and which bit
+             * to set to record that it has been seen.
+             */
+            struct object_rules {
+                static constexpr std::size_t no_bit = ~std::size_t{};
+
+                struct name_hash {
+                    std::size_t operator()(u8view n) const {
+                        return std::hash<std::string_view>{}(
+                                std::string_view{n.data(), n.bytes()});
+                    }
+                };
+                /// What is known about a member name
+                struct key {
+                    /// The `properties` sub-schema for it
+                    const node *property = nullptr;
+                    /// The `dependencies` sub-schema for it
+                    const node *dependent_schema = nullptr;
+                    /// The names (and their bits) that a `dependencies`
+                    /// array says must also be present
+                    std::vector<std::pair<value, std::size_t>> depends_on;
+                    /// The bit recording that it was seen, or `no_bit`
+                    std::size_t bit = no_bit;
+                };
+
+                /// The keywords' rules, or `nullptr` if the node doesn't
+                /// have them
+                const rule *properties = nullptr, *pattern_properties = nullptr,
+                           *additional_properties = nullptr,
+                           *property_names = nullptr, *required = nullptr,
+                           *dependencies = nullptr;
+                /// The first of the fused rules. The object is checked when
+                /// the node gets to this one
+                const rule *lead = nullptr;
+
+                std::unordered_map<fostlib::string, key, name_hash> keys;
+                /// The bits for the `required` names
+                std::vector<std::size_t> required_bits;
+                /// The names that a `dependencies` array is given for, in
+                /// name order, together with their bits
+                std::vector<std::pair<std::size_t, const key *>> dependent;
+                std::size_t bits = 0;
+
+                /// Work out the object rules for the node. Returns `nullptr`
+                /// if there is nothing to be gained, or the keywords are not
+                /// well formed (in which case the separate checkers will
+                /// report the problem).
+                static std::unique_ptr<const object_rules> compile(node &);
+
+                /// Check the data, which need not be an object
+                validation::result check(validation::annotations) const;
+            };
+
+
+            /**
+             * ## Compiled node
+             *
+             * A schema (or sub-schema) position with everything needed to
+             * apply it already worked out.
+             */
+            struct node {
+                enum class kind {
+                    always,
+                    never,
+                    reference,
+                    assertions,
+                    malformed
+                };
+
+                /// The graph that this node is part of
+                const graph *owner;
+                /// The location of this node in the graph's schema JSON
+                pointer spos;
+                /// The schema JSON for this node
+                value part;
+                kind type;
+                /// The `$ref` if this is a reference
+                u8view ref;
+                /// True if the schema JSON has a `$id`
+                bool has_id = false;
+                /// The rules in the order in which they are to be checked
+                std::vector<rule> rules;
+                /// The rules that have a checker to run, in order. This
+                /// leaves out those that are only used by their siblings
+                /// and those checked as part of the `object` rules.
+                std::vector<const rule *> checks;
+                /// For each keyword, the index of its rule plus one, or
+                /// zero if the node doesn't have the keyword
+                std::array<std::uint8_t, keyword_count> slots{};
+                /// The object keywords compiled together, if there are any
+                std::unique_ptr<const object_rules> object;
+
+                /// Where a `$ref` leads. This is worked out the first time
+                /// that the reference is followed and then re-used.
+                struct link {
+                    std::once_flag once;
+                    /// The node for a reference within the same schema
+                    /// document
+                    const node *local = nullptr;
+                    /// For a reference to another schema, its absolute URL
+                    /// and the position within it
+                    fostlib::string url;
+                    pointer fragment;
+                    /// The schema and node that the URL and position lead
+                    /// to in the schema cache. Looked up the first time
+                    /// they're needed, see `external`.
+                    std::once_flag cached;
+                    const json::schema *cached_schema = nullptr;
+                    const node *cached_node = nullptr;
+                };
+
+                /// Return the rule for the requested keyword, or `nullptr`
+                const rule *find(keyword k) const {
+                    const auto slot = slots[std::size_t(k)];
+                    return slot ? &rules[slot - 1] : nullptr;
+                }
+                const rule *find(u8view) const;
+                /// Return where the `$ref` leads. Only valid when the node
+                /// is a `kind::reference`
+                const link &follow() const;
+                /// Return the schema and node that a `$ref` to another
+                /// schema leads to. A `$id` in scope takes precedence,
+                /// otherwise the schema cache is only searched the first
+                /// time that the reference is followed.
+                std::pair<const json::schema &, const node &>
+                        external(const validation::scope &) const;
+
+              private:
+                mutable link target;
+            };
+
+
+            /// A hash of a JSON value that follows its structure, so values
+            /// that compare equal have the same hash. Numbers are hashed by
+            /// their value as a `double`, so `1` and `1.0` hash the same.
+            std::size_t hash(const value &);
+
+
+            /**
+             * ## Compiled graph
+             *
+             * All of the nodes for a single schema JSON document. The graph
+             * is immutable once built, apart from nodes which are compiled
+             * on demand when a `$ref` points somewhere that is not itself a
+             * sub-schema position. These are guarded by a mutex, so the
+             * graph is safe to use from multiple threads.
+             */
+            class graph : public std::enable_shared_from_this<graph> {
+                fostlib::url base;
+                value schema_json;
+                std::deque<node> nodes;
+                std::map<value, const node *> index;
+
+                mutable std::mutex late_mutex;
+                mutable std::deque<node> late_nodes;
+                mutable std::map<value, const node *> late_index;
+
+                static node &compile(
+                        const graph *,
+                        std::deque<node> &,
+                        std::map<value, const node *> &,
+                        pointer,
+                        value);
+
+              public:
+                /// Compile the schema JSON. The URL is the schema's own
+                /// location and is used to resolve any `$ref`s
+                graph(const fostlib::url &, value);
+
+                graph(const graph &) = delete;
+                graph &operator=(const graph &) = delete;
+
+                /// The schema JSON that the graph was compiled from
+                value assertions() const { return schema_json; }
+                /// The URL that a `$ref` at the requested position is
+                /// resolved against, taking into account any `$id` found
+                /// in the lexical parents of that position
+                fostlib::url url_for(const pointer &) const;
+
+                /// The node for the whole schema
+                const node &root() const { return nodes.front(); }
+                /// The node at a position relative to another node in
+                /// this graph
+                const node &at(const node &, const pointer &) const;
+                /// The node at an absolute position in the schema
+                const node &at(const pointer &p) const { return at(root(), p); }
+
+                /// A new graph for the same schema JSON, with the checks
+                /// of each node re-ordered by how cheaply the profile of
+                /// this graph found them to reject data. This graph is not
+                /// changed. See `schema::reorder`.
+                std::shared_ptr<graph>
+                        reordered(const validation::profile &) const;
+            };
+
+
+        }
+
+
+    }
+
+
+}
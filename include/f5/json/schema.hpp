@@ -11,6 +11,8 @@
 #include <f5/json/validator.hpp>
 #include <fost/url>
 
+#include <iosfwd>
+
 
 namespace f5 {
 
@@ -18,6 +20,26 @@ namespace f5 {
     namespace json {
 
 
+        /// Controls how `schema::validate_batch` spreads its work
+        struct batch_options {
+            /// The number of threads to use, which is never more than
+            /// one for each hardware thread. Zero means one for each
+            /// hardware thread
+            std::size_t threads = 0;
+            /// Stop validating once any document has failed. Every
+            /// document before the first failing one will still have a
+            /// result, but those after it may not
+            bool stop_on_failure = false;
+        };
+
+
+        /// Apply a JSON Patch (RFC 6902) to the data, returning the patched
+        /// data and adding the positions it changed to `changed`. If an
+        /// operation can't be applied an exception is thrown.
+        value apply_patch(
+                value, const value &patch, validation::changes &changed);
+
+
         /**
             ## JSON Schema
 
@@ -27,19 +49,106 @@ namespace f5 {
         class schema {
             fostlib::url id;
             value validation;
+            std::shared_ptr<const compiled::graph> graph;
+            const compiled::node *node;
+            std::shared_ptr<const schema_cache> ids;
 
           public:
+            /// Compile the schema JSON ready for validation
             schema(const fostlib::url &, value v);
+            /// A schema for a sub-schema of one that has already been
+            /// compiled. The compiled graph is shared with the parent.
+            schema(const fostlib::url &, const compiled::node &);
 
             const fostlib::url &self() const { return id; }
             value assertions() const { return validation; }
+            /// The compiled form of the schema
+            const compiled::node &root() const { return *node; }
+            /// The sub-schemas that have a `$id` (including those in
+            /// `definitions`). This is built once when the schema JSON is
+            /// compiled and is `nullptr` for a schema made from a
+            /// sub-schema.
+            const std::shared_ptr<const schema_cache> &identifiers() const {
+                return ids;
+            }
 
             /// If the schema doesn't validate return the first position
             /// in the schema that fails.
             ///
             /// It is safe to call this from multiple threads at the same
+            /// time. The result of a successful validation refers to the
+            /// data, so the data must live at least as long as the result.
+            validation::result validate(const value &) const;
+            /// Validate and add the time spent in each part of the schema
+            /// to the profile
+            validation::result
+                    validate(const value &, validation::profile &) const;
+            /// Validate, remembering the outcome of each sub-schema for each
+            /// part of the data so that none is applied more than once. See
+            /// `validation::memo` for details.
+            validation::result
+                    validate(const value &, validation::memo &) const;
+            /// Validate, checking the children of large arrays and objects
+            /// on several threads. See `validation::parallel` for details.
+            validation::result
+                    validate(const value &, const validation::parallel &) const;
+            /// Check data that passed this schema before the data at the
+            /// changed positions was altered. Only the sub-schemas that
+            /// apply to the changed positions, or to the arrays and objects
+            /// that hold them, are checked again. See
+            /// `validation::changes` for details.
+            validation::result
+                    revalidate(
+                            const value &,
+                            const validation::changes &) const;
+            /// Apply a JSON Patch to data that passed this schema and check
+            /// the patched data, only checking again what the patch could
+            /// have affected. Returns the patched data and the result.
+            std::pair<value, validation::result>
+                    revalidate(value, const value &patch) const;
+            /// Parse and validate JSON from the input without building
+            /// all of it in memory. See `validation::stream` for details.
+            validation::result validate(std::istream &) const;
+            /// Validate the whole of the data, returning every error that
+            /// is found (in the order they were found), up to `limit` of
+            /// them (a `limit` of zero is treated as one). An empty result
+            /// means that the data is valid. If a profile is given then the
+            /// time spent in each part of the schema is added to it.
+            ///
+            /// It is safe to call this from multiple threads at the same
             /// time.
-            validation::result validate(value) const;
+            std::vector<validation::result::error>
+                    validate_all(
+                            const value &,
+                            std::size_t limit,
+                            validation::profile * = nullptr) const;
+
+            /// Re-order the checks in the compiled schema using the
+            /// failure counts and times gathered in a profile of real
+            /// traffic, so that the checks that reject data most cheaply
+            /// run first. Checks that the profile has no figures for stay
+            /// where they are (when compiled the cheapest keywords are put
+            /// first). Only the order in which errors are found changes,
+            /// never whether the data is valid.
+            ///
+            /// The checks are re-ordered in a new copy of the compiled
+            /// graph which only this schema uses from then on. Copies of
+            /// the schema (for example those in the schema caches) and
+            /// schemas made from a part of it keep the graph they had, so
+            /// they can carry on validating on other threads.
+            void reorder(const validation::profile &);
+
+            /// Validate a batch of documents across several threads. The
+            /// results are in the same order as the documents. A document
+            /// that was skipped because of `stop_on_failure` has no result.
+            std::vector<std::optional<validation::result>> validate_batch(
+                    const std::vector<value> &,
+                    batch_options = batch_options{}) const;
+            template<typename I>
+            std::vector<std::optional<validation::result>> validate_batch(
+                    I begin, I end, batch_options o = batch_options{}) const {
+                return validate_batch(std::vector<value>(begin, end), o);
+            }
         };
 
 
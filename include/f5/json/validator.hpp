@@ -11,6 +11,13 @@
 #include <fost/json>
 #include <fost/url>
 
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
 
 namespace f5 {
 
@@ -26,10 +33,102 @@ namespace f5 {
         class schema_cache;
 
 
+        namespace compiled {
+            class graph;
+            struct node;
+            struct rule;
+        }
+
+
         namespace validation {
 
 
             class result;
+            class stream;
+            struct collector;
+            class profile;
+            class memo;
+            struct parallel;
+            class changes;
+
+
+            /**
+             * ## Data path
+             *
+             * The position in the data that is being validated. A step
+             * into an array or object makes a new path that refers back to
+             * the one it was made from, so the path can be extended without
+             * allocating any memory. It is only turned into a `pointer`
+             * when it is needed for an error.
+             *
+             * A path refers to its parent and to the property name it was
+             * given, so it must not outlive either of them.
+             */
+            class path {
+                enum class step : unsigned char { root, key, index };
+
+                const path *parent = nullptr;
+                u8view key;
+                std::size_t index = 0;
+                step kind = step::root;
+
+                friend changes;
+
+                path(const path *p, u8view k)
+                : parent{p}, key{k}, kind{step::key} {}
+                path(const path *p, std::size_t i)
+                : parent{p}, index{i}, kind{step::index} {}
+
+              public:
+                /// The root of the data
+                path() = default;
+
+                path operator/(u8view k) const { return path{this, k}; }
+                path operator/(const fostlib::string &k) const {
+                    return path{this, u8view{k}};
+                }
+                path operator/(std::size_t i) const { return path{this, i}; }
+
+                /// The position as a JSON pointer
+                pointer as_pointer() const;
+                /// The number of steps from the root to the position
+                std::size_t depth() const;
+            };
+
+
+            /**
+             * ## Identifier scope
+             *
+             * The `$id`s that `$ref`s can see from the current position.
+             * These are the ones in the schema being applied, then those in
+             * the schemas whose `$ref`s led to it, and finally the root
+             * cache. A schema's `$id`s are indexed when it is compiled, and
+             * the scope for a schema reached through a `$ref` refers back
+             * to the one it was reached from, so no caches are built during
+             * validation.
+             *
+             * Like a `path`, a scope must not outlive the one it refers to.
+             */
+            class scope {
+                const schema_cache *ids = nullptr;
+                const scope *outer = nullptr;
+                const schema_cache *root = nullptr;
+
+              public:
+                /// The `$id`s of the schema, then the root cache
+                explicit scope(const schema &);
+                /// The `$id`s of the schema, then those of the outer scope
+                scope(const schema &, const scope &outer);
+
+                /// Look up the schema with the URL
+                const schema &operator[](u8view) const;
+                /// The schema with the URL from the `$id`s in scope, or
+                /// `nullptr` if it would come from the root cache
+                const schema *find(u8view) const;
+                /// The schema that was indexed for a compiled node, or
+                /// `nullptr` if there is none
+                const schema *find(const compiled::node &) const;
+            };
 
 
             /**
@@ -44,40 +143,80 @@ namespace f5 {
              */
             struct annotations {
                 const schema *base;
-                value sroot;
-                pointer spos;
-                value data;
-                pointer dpos;
-
-                std::shared_ptr<schema_cache> schemas;
+                /// The compiled schema node being applied. Its position
+                /// in the schema is `snode->spos`
+                const compiled::node *snode;
+                /// The data at `dpos`. It isn't owned, so the annotations
+                /// must not be used once the data being validated has gone
+                const value *data;
+                path dpos;
+
+                scope schemas;
+
+                /// When looking for all errors (rather than just the first)
+                /// this is where they are stored. Checkers that evaluate a
+                /// sub-schema only to find out whether it passes (e.g.
+                /// `anyOf` or `not`) must set this to `nullptr` for that
+                /// evaluation.
+                collector *errors = nullptr;
+                /// When set, the time spent in each sub-schema and keyword
+                /// is added to this
+                profile *profiling = nullptr;
+                /// When set, the outcome of applying each sub-schema to each
+                /// part of the data is remembered here and re-used. Anything
+                /// that validates a value that is not part of the data (e.g.
+                /// `propertyNames`) must set this to `nullptr`.
+                memo *memoised = nullptr;
+                /// When set, large arrays and objects may have their
+                /// children checked on several threads. See `parallel`.
+                const parallel *parallelism = nullptr;
+                /// When re-checking data that passed before it was changed,
+                /// the changes at and below this position. The node is
+                /// known to have passed the data before, so only what
+                /// changed needs checking again. Anything that applies a
+                /// sub-schema which needn't have passed before (e.g. the
+                /// branches of `anyOf`) must set this to `nullptr`, which
+                /// means that everything must be checked.
+                const changes *changed = nullptr;
 
               private:
                 friend class json::schema;
+                friend class stream;
                 /// Construct the initial location
-                annotations(
-                        const json::schema &s, pointer sp, value d, pointer dp);
+                annotations(const json::schema &s, const value &d);
 
               public:
                 /// Construct a later annotation, but allow more replacements
                 annotations(
                         annotations &a,
                         const json::schema &s,
-                        pointer sp,
-                        value d,
-                        pointer dp);
+                        const compiled::node &sn,
+                        const value &d,
+                        path dp);
                 /// Construct an annotations for another part of the validation
-                annotations(annotations &, pointer sp, pointer dp);
+                annotations(
+                        annotations &,
+                        const compiled::node &sn,
+                        const value &d,
+                        path dp);
+                /// Construct an annotations for applying another node at
+                /// the same position in the data
+                annotations(annotations &, const compiled::node &sn);
 
                 /// Construct by merging
                 annotations(annotations &&base, result &&with);
 
                 /// Merge a result with this annotation
                 annotations &merge(result &&);
-
-                /// Return the base URL for this part of the schema based
-                /// on the local $id found in parent lexical scopes of the
-                /// JSON
-                fostlib::url spos_url() const;
+                /// Record a failed result when collecting all errors.
+                /// Returns `true` if validation should carry on as if the
+                /// result had passed, or `false` if it should stop and
+                /// return the error, i.e. when not collecting errors or
+                /// when the limit has been reached.
+                bool record(const result &);
+
+                /// The data at the current position
+                const value &current() const { return *data; }
             };
 
 
@@ -93,12 +232,22 @@ namespace f5 {
 
               private:
                 friend annotations;
+                friend memo;
+                friend class json::schema;
                 std::variant<error, annotations> outcome;
 
+                /// Stop the annotations of a passing result from referring
+                /// to data that may not live as long as the result does
+                void detach();
+
               public:
                 /// Describe a result that has an error
                 result(u8view assertion, pointer spos, pointer dpos)
                 : outcome{error{assertion, std::move(spos), std::move(dpos)}} {}
+                /// Describe an error, only now building the data pointer
+                result(u8view assertion, pointer spos, const path &dpos)
+                : outcome{error{
+                        assertion, std::move(spos), dpos.as_pointer()}} {}
                 /// Return an annotation for merging into the base one
                 result(annotations an) : outcome{std::move(an)} {}
 
@@ -117,16 +266,301 @@ namespace f5 {
             };
 
 
-            /// Perform the check
+            /// The errors found when validating in all-errors mode
+            struct collector {
+                std::vector<result::error> errors;
+                std::size_t limit;
+
+                bool full() const { return errors.size() >= limit; }
+            };
+
+
+            /**
+             * ## Memo
+             *
+             * Remembers whether the target of each `$ref` passed or failed
+             * for each part of the data during a single validation, so that
+             * a sub-schema reached more than once for the same data (e.g.
+             * through `anyOf`, `oneOf`, `not` and `if` branches that refer to
+             * the same definitions) is only applied once. Only outcomes
+             * found whilst looking for the first error are remembered, as
+             * re-using them when all of the errors are wanted would lose
+             * some.
+             *
+             * The parts of the data are told apart by their address, so a
+             * memo is cleared at the start of each validation that uses it.
+             * The same value may be found at more than one position in the
+             * data, so the data position of a remembered error is kept
+             * relative to the value it was found for.
+             */
+            class memo {
+                struct key_hash {
+                    std::size_t operator()(const std::pair<
+                                           const compiled::node *,
+                                           const value *> &k) const {
+                        return std::hash<const void *>{}(k.first) * 31
+                                ^ std::hash<const void *>{}(k.second);
+                    }
+                };
+                std::unordered_map<
+                        std::pair<const compiled::node *, const value *>,
+                        std::optional<result::error>,
+                        key_hash>
+                        outcomes;
+
+              public:
+                /// The remembered outcome, which is empty if the data
+                /// passed, or `nullptr` if there isn't one. The `dpos` of
+                /// an error is relative to the data.
+                const std::optional<result::error> *
+                        find(const compiled::node &, const value &) const;
+                /// Remember the outcome for the data, which is at the
+                /// position in the data being validated
+                void remember(
+                        const compiled::node &,
+                        const value &,
+                        const path &,
+                        const result &);
+
+                /// The number of outcomes remembered
+                std::size_t size() const { return outcomes.size(); }
+                /// Forget everything
+                void clear() { outcomes.clear(); }
+            };
+
+
+            /**
+             * ## Parallel
+             *
+             * Controls the checking of the items of large arrays and the
+             * members of large objects on several threads. The children are
+             * split into chunks which the threads take in order from a
+             * shared cursor, so a thread that gets cheap children simply
+             * takes more of them.
+             *
+             * The error reported is always the one for the lowest index,
+             * just as when checking on a single thread. Once an error has
+             * been found chunks after it are skipped and checking stops.
+             *
+             * Only the outermost large array or object is split, and only
+             * when looking for the first error without a profile or memo.
+             */
+            struct parallel {
+                /// The number of threads to use, which is never more than
+                /// one for each hardware thread. Zero means one for each
+                /// hardware thread
+                std::size_t threads = 0;
+                /// Arrays and objects with fewer children than this are
+                /// checked on the current thread
+                std::size_t threshold = 10000;
+                /// The number of children each thread takes at a time
+                std::size_t chunk = 256;
+            };
+
+
+            /**
+             * ## Thread pool
+             *
+             * The threads that `parallel` validation and
+             * `schema::validate_batch` share their work with. They are
+             * started the first time they are wanted and then kept, so the
+             * cost of starting a thread is only paid once. The pool never
+             * grows past the number of hardware threads, as its jobs are
+             * meant to keep the CPUs busy rather than wait on I/O.
+             *
+             * A job is run on the calling thread and on as many of the
+             * pool's threads as are free to help. The copies of the job
+             * share its work out between themselves, so the job must still
+             * be finished if no other thread ever helps.
+             */
+            class pool {
+                struct state;
+                std::unique_ptr<state> self;
+
+              public:
+                pool();
+                ~pool();
+
+                /// The pool used by the whole process
+                static pool &shared();
+
+                /// Run the job on the calling thread and on up to `helpers`
+                /// of the pool's threads at the same time. Returns once
+                /// every copy that was started has finished. If any copy
+                /// throws then one of the exceptions is re-thrown here.
+                void run(std::size_t helpers, const std::function<void()> &);
+            };
+
+
+            /**
+             * ## Changes
+             *
+             * The positions in data that have changed since it last passed
+             * validation, held as a tree that follows the shape of the data.
+             * Each position in the tree has either changed completely (it
+             * was added, removed or replaced) or has changes somewhere below
+             * it. A position that isn't in the tree hasn't changed.
+             *
+             * When items are inserted into or removed from an array every
+             * item after them has moved, so those positions must be added
+             * too.
+             *
+             * Keywords that look at the whole of an array or object (e.g.
+             * `required` or `uniqueItems`) are checked again wherever
+             * something below them changed. Sub-schemas reached through
+             * `anyOf`, `oneOf`, `not`, `if` and `contains` needn't have
+             * passed before, so they are checked in full.
+             */
+            class changes {
+                bool whole = false;
+                /// Array items are held by their index written out in
+                /// decimal, the same as a JSON pointer does
+                std::map<fostlib::string, changes> below;
+
+              public:
+                changes() = default;
+                /// Record the positions as having changed completely
+                explicit changes(const std::vector<pointer> &);
+
+                /// Record that the data at the position changed completely
+                void add(const pointer &);
+
+                /// Returns `true` if nothing changed here
+                bool unchanged() const { return not whole && below.empty(); }
+                /// Returns `true` if this position changed completely
+                bool everything() const { return whole; }
+                /// The changes for a child of this position, or `nullptr`
+                /// if the child changed completely
+                const changes *at(const path &child) const;
+
+                /// The object members that changed, in name order
+                const std::map<fostlib::string, changes> &
+                        changed_members() const {
+                    return below;
+                }
+                /// The indexes of the array items that changed, in order
+                std::vector<std::size_t> changed_items() const;
+            };
+
+
+            /**
+             * ## Profile
+             *
+             * Counts how many times each sub-schema and keyword was applied
+             * and how long it took. The times include any sub-schemas that
+             * were checked as part of it, so a `$ref` back into the same
+             * schema is counted at each level.
+             *
+             * A profile can be used for any number of validations, but only
+             * one at a time.
+             */
+            class profile {
+              public:
+                struct counter {
+                    std::size_t calls = 0;
+                    /// How many of the calls found the data to be invalid
+                    std::size_t failures = 0;
+                    std::chrono::nanoseconds time{};
+                };
+
+                struct location {
+                    /// The position in the schema. Positions in a referenced
+                    /// schema are relative to that schema
+                    pointer spos;
+                    /// The keyword, or empty for a whole sub-schema
+                    u8view keyword;
+                    counter total;
+                };
+
+                /// The totals for each keyword
+                std::map<fostlib::string, counter> keywords() const;
+                /// The totals for each sub-schema and each keyword in it,
+                /// slowest first
+                std::vector<location> locations() const;
+                /// The totals for a single rule
+                counter totals(const compiled::rule &) const;
+                /// Forget everything counted so far
+                void clear();
+
+                /// Times the application of a node or rule until it goes
+                /// out of scope. Does nothing if there is no profile.
+                class timer {
+                    counter *total = nullptr;
+                    std::chrono::steady_clock::time_point started;
+
+                  public:
+                    timer(profile *p, const compiled::node &n)
+                    : total{p ? &p->nodes[&n] : nullptr} {
+                        if (total) started = std::chrono::steady_clock::now();
+                    }
+                    timer(profile *p, const compiled::rule &r)
+                    : total{p ? &p->rules[&r] : nullptr} {
+                        if (total) started = std::chrono::steady_clock::now();
+                    }
+                    /// Count the call as one where the data was invalid
+                    void failed() const {
+                        if (total) ++total->failures;
+                    }
+                    ~timer() {
+                        if (total) {
+                            ++total->calls;
+                            total->time +=
+                                    std::chrono::steady_clock::now() - started;
+                        }
+                    }
+
+                    timer(const timer &) = delete;
+                    timer &operator=(const timer &) = delete;
+                };
+
+              private:
+                std::unordered_map<const compiled::node *, counter> nodes;
+                std::unordered_map<const compiled::rule *, counter> rules;
+            };
+
+
+            /// Perform the check. When the annotations have a `collector`
+            /// then failures are recorded there and validation carries on
+            /// until the collector is full.
             result first_error(annotations);
             /// Recurse down into another level of the validation
+            inline result first_error(
+                    annotations &an,
+                    const compiled::node &sn,
+                    const value &data,
+                    path dpos) {
+                return first_error(annotations{an, sn, data, dpos});
+            }
+            /// Apply another node to the same data
             inline result
-                    first_error(annotations &an, pointer spos, pointer dpos) {
-                return first_error(
-                        annotations{an, std::move(spos), std::move(dpos)});
+                    first_error(annotations &an, const compiled::node &sn) {
+                return first_error(annotations{an, sn});
             }
 
 
+            /// A check of a single child (an array item or an object member)
+            /// of the current data
+            using child_check =
+                    std::function<result(annotations &, std::size_t)>;
+            /// Returns `true` if `count` children of the current data will
+            /// be checked on several threads
+            bool in_parallel(const annotations &, std::size_t count);
+            /// Check the children of the current data from index `begin` up
+            /// to `end`, stopping at the first that fails. The children are
+            /// checked on several threads when `in_parallel` says so. When
+            /// re-checking changed data only the changed children are
+            /// checked.
+            result each_child(
+                    annotations,
+                    std::size_t begin,
+                    std::size_t end,
+                    const child_check &);
+            /// Returns `true` if any of `count` children of the current data
+            /// passes the check, stopping as soon as one does
+            bool any_child(
+                    annotations &, std::size_t count, const child_check &);
+
+
         }
 
 
@@ -0,0 +1,86 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+
+#pragma once
+
+#include <f5/json/schema.hpp>
+
+#include <iosfwd>
+
+
+namespace f5 {
+
+
+    namespace json {
+
+
+        namespace validation {
+
+
+            /**
+             * ## Streaming validation
+             *
+             * Validates a single JSON value from parse events without
+             * building the whole of it in memory. Objects and arrays are
+             * checked as their members arrive for the keywords that can be
+             * checked that way (`type`, `properties`, `items`, `required`
+             * etc.) so that the memory used grows with the nesting depth
+             * rather than the size of the data.
+             *
+             * Where a schema needs the whole of a value (for example
+             * `enum`, `anyOf` or `uniqueItems`) only that value is built
+             * and then checked with `first_error`.
+             *
+             * Once validation has failed any further events are ignored.
+             * The error reported may not be the same one that `validate`
+             * would find first.
+             */
+            class stream {
+                struct state;
+                std::unique_ptr<state> self;
+
+              public:
+                /// Validate against the schema. The schema must outlive the
+                /// validator.
+                explicit stream(const schema &);
+                ~stream();
+
+                stream(const stream &) = delete;
+                stream &operator=(const stream &) = delete;
+
+                /// Parse events
+                void start_object();
+                void key(u8view);
+                void end_object();
+                void start_array();
+                void end_array();
+                void scalar(value);
+
+                /// True once validation has failed
+                bool failed() const;
+                /// True once a whole JSON value has been seen
+                bool complete() const;
+
+                /// The outcome of the validation. Throws if the value is
+                /// not yet complete and there has been no error.
+                result outcome() const;
+            };
+
+
+            /// Parse JSON from the input and send the events to the
+            /// validator. Parsing stops as soon as validation fails.
+            void parse(std::istream &, stream &);
+
+
+        }
+
+
+    }
+
+
+}
@@ -5,12 +5,16 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/schema.hpp>
+#include <f5/json/mapped_file.hpp>
+#include <f5/json/validator.stream.hpp>
 
 #include <fost/file>
 #include <fost/main>
 #include <fost/unicode>
 
+#include <atomic>
+#include <thread>
+
 
 namespace {
     const fostlib::setting<bool> c_verbose(
@@ -21,6 +25,32 @@ namespace {
             "Success when invalid",
             false,
             true);
+    const fostlib::setting<int64_t> c_max_errors(
+            __FILE__,
+            "json-schema-validator",
+            "Maximum errors to report",
+            1,
+            true);
+
+    const fostlib::setting<bool> c_profile(
+            __FILE__,
+            "json-schema-validator",
+            "Print where validation spent its time",
+            false,
+            true);
+
+    const fostlib::setting<bool> c_ndjson(
+            __FILE__,
+            "json-schema-validator",
+            "Newline delimited JSON",
+            false,
+            true);
+    const fostlib::setting<int64_t> c_threads(
+            __FILE__,
+            "json-schema-validator",
+            "Threads (zero means one per core)",
+            0,
+            true);
 
     const fostlib::setting<fostlib::string> c_schema(
             __FILE__,
@@ -44,6 +74,145 @@ namespace {
                   << "\nSchema: " << s.assertions()[e.spos]
                   << "\nData: " << d[e.dpos] << std::endl;
     }
+
+
+    /// Print the keyword totals followed by the slowest schema positions
+    void print(const f5::json::validation::profile &p) {
+        const auto us = [](const auto &c) {
+            return std::chrono::duration<double, std::micro>(c.time).count();
+        };
+        std::cout << "\nKeyword calls, failures and time (us)\n";
+        for (const auto &k : p.keywords()) {
+            std::cout << k.first << ' ' << k.second.calls << ' '
+                      << k.second.failures << ' ' << us(k.second) << '\n';
+        }
+        std::cout << "\nSlowest schema positions, calls and time (us)\n";
+        const auto locations = p.locations();
+        for (std::size_t i{}; i < locations.size() && i < 20; ++i) {
+            const auto &l = locations[i];
+            std::cout << '#' << l.spos;
+            if (l.keyword.bytes()) std::cout << " (" << l.keyword << ')';
+            std::cout << ' ' << l.total.calls << ' ' << us(l.total) << '\n';
+        }
+        std::cout << std::flush;
+    }
+
+
+    /// Lets the stream parser read straight out of the mapped memory
+    struct memory_buffer : public std::streambuf {
+        memory_buffer(const char *b, const char *e) {
+            setg(const_cast<char *>(b), const_cast<char *>(b),
+                 const_cast<char *>(e));
+        }
+    };
+
+
+    struct line_error {
+        std::size_t line;
+        std::optional<f5::json::validation::result::error> error;
+        std::string message = {};
+    };
+
+
+    /// Validate each line of a newline delimited JSON file. The file is
+    /// split into line aligned chunks which are validated in parallel. The
+    /// errors are printed in line order, followed by a summary, and the
+    /// number of lines that didn't give the expected outcome is returned.
+    std::size_t ndjson(const f5::json::schema &s, const fostlib::string &fn) {
+        const f5::json::mapped_file file{
+                fostlib::coerce<boost::filesystem::path>(fn)};
+        const bool want_valid = not c_check_invalid.value();
+
+        std::size_t threads = c_threads.value() > 0
+                ? c_threads.value()
+                : std::max(std::thread::hardware_concurrency(), 1u);
+        const std::size_t size = file.end() - file.begin();
+        const std::size_t chunks =
+                std::max<std::size_t>(std::min(size / 4096, threads * 8), 1);
+
+        /// Work out where each chunk starts so that they all begin at the
+        /// start of a line
+        std::vector<const char *> starts{file.begin()};
+        for (std::size_t c{1}; c < chunks; ++c) {
+            const char *p = std::max(file.begin() + size * c / chunks,
+                                     starts.back());
+            p = std::find(p, file.end(), '\n');
+            if (p != file.end()) ++p;
+            starts.push_back(p);
+        }
+        starts.push_back(file.end());
+
+        struct chunk_result {
+            /// Every line, including the blank ones that aren't validated,
+            /// so that errors can be given their line number in the file
+            std::size_t lines = 0;
+            std::size_t validated = 0;
+            std::vector<line_error> errors;
+        };
+        std::vector<chunk_result> results(chunks);
+        std::atomic<std::size_t> next{};
+        const auto worker = [&]() {
+            for (auto c = next++; c < chunks; c = next++) {
+                auto &result = results[c];
+                for (const char *line = starts[c]; line < starts[c + 1];) {
+                    const char *eol = std::find(line, starts[c + 1], '\n');
+                    ++result.lines;
+                    if (std::find_if(
+                                line, eol,
+                                [](char ch) {
+                                    return ch != ' ' && ch != '\t'
+                                            && ch != '\r';
+                                })
+                        != eol) {
+                        ++result.validated;
+                        memory_buffer buffer{line, eol};
+                        std::istream in{&buffer};
+                        try {
+                            auto v = s.validate(in);
+                            if (v && not want_valid) {
+                                result.errors.push_back(line_error{
+                                        result.lines, {},
+                                        "validated when it should not "
+                                        "have"});
+                            } else if (not v && want_valid) {
+                                using error = f5::json::validation::result::
+                                        error;
+                                result.errors.push_back(line_error{
+                                        result.lines,
+                                        static_cast<error>(std::move(v))});
+                            }
+                        } catch (std::exception &e) {
+                            result.errors.push_back(
+                                    line_error{result.lines, {}, e.what()});
+                        }
+                    }
+                    line = eol == starts[c + 1] ? eol : eol + 1;
+                }
+            }
+        };
+        threads = std::min(threads, chunks);
+        f5::json::validation::pool::shared().run(threads - 1, worker);
+
+        std::size_t lines{}, validated{}, failed{};
+        for (const auto &result : results) {
+            for (const auto &e : result.errors) {
+                std::cout << fn << ":" << (lines + e.line) << ": ";
+                if (e.error) {
+                    std::cout << e.error->assertion << " at "
+                              << e.error->dpos << " (schema position "
+                              << e.error->spos << ")\n";
+                } else {
+                    std::cout << e.message << '\n';
+                }
+            }
+            lines += result.lines;
+            validated += result.validated;
+            failed += result.errors.size();
+        }
+        std::cout << fn << ": " << validated << " lines validated, " << failed
+                  << (want_valid ? " invalid" : " valid") << std::endl;
+        return failed;
+    }
 }
 
 
@@ -51,29 +220,53 @@ FSL_MAIN("json-schema-validator", "JSON Schema Validator")
 (fostlib::ostream &out, fostlib::arguments &args) {
     args.commandSwitch("i", c_check_invalid);
     args.commandSwitch("v", c_verbose);
+    args.commandSwitch("-errors", c_max_errors);
+    args.commandSwitch("-profile", c_profile);
+    args.commandSwitch("-ndjson", c_ndjson);
+    args.commandSwitch("-threads", c_threads);
     args.commandSwitch("-schema", c_schema);
 
     const f5::json::schema s{fostlib::url{}, load_json(c_schema.value())};
 
+    if (c_ndjson.value()) {
+        std::size_t failed{};
+        for (const auto &arg : args) {
+            if (c_verbose.value()) {
+                std::cout << "Validating lines in " << arg << std::endl;
+            }
+            failed += ndjson(s, arg);
+        }
+        return failed ? (c_check_invalid.value() ? 2 : 1) : 0;
+    }
+
+    f5::json::validation::profile profile;
+    const auto profiling = c_profile.value() ? &profile : nullptr;
     for (const auto &arg : args) {
         if (c_verbose.value()) {
             std::cout << "Loading and validating " << arg << std::endl;
         }
         const auto j = load_json(arg);
         if (c_check_invalid.value()) {
-            if (const auto v = s.validate(j); v) {
+            if (const auto v = profiling ? s.validate(j, profile)
+                                         : s.validate(j);
+                v) {
                 std::cout << arg << " validated when it should not have"
                           << std::endl;
+                if (profiling) print(profile);
                 return 2;
             }
         } else {
-            if (auto v = s.validate(j); not v) {
+            if (const auto errors =
+                        s.validate_all(j, c_max_errors.value(), profiling);
+                not errors.empty()) {
                 std::cout << arg << " did not validate" << std::endl;
-                print(s, j, (f5::json::validation::result::error)std::move(v));
+                for (const auto &e : errors) print(s, j, e);
+                if (profiling) print(profile);
                 return 1;
             }
         }
     }
 
+    if (profiling) print(profile);
     return 0;
 }
@@ -5,44 +5,79 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/assertions.hpp>
 #include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
 #include <fost/push_back>
 #include <fost/unicode>
 
 
+/**
+ * ## `f5::json::validation::scope`
+ */
+
+
+f5::json::validation::scope::scope(const schema &s)
+: ids{s.identifiers().get()}, root{schema_cache::root_cache().get()} {}
+
+
+f5::json::validation::scope::scope(const schema &s, const scope &o)
+: ids{s.identifiers().get()}, outer{&o} {}
+
+
+auto f5::json::validation::scope::operator[](u8view u) const
+        -> const schema & {
+    for (auto s = this;; s = s->outer) {
+        if (s->ids) {
+            if (const auto found = s->ids->find(u); found) return *found;
+        }
+        if (not s->outer) return (*s->root)[u];
+    }
+}
+
+
+auto f5::json::validation::scope::find(u8view u) const -> const schema * {
+    for (auto s = this; s; s = s->outer) {
+        if (s->ids) {
+            if (const auto found = s->ids->find(u); found) return found;
+        }
+    }
+    return nullptr;
+}
+
+
+auto f5::json::validation::scope::find(const compiled::node &n) const
+        -> const schema * {
+    for (auto s = this;; s = s->outer) {
+        if (s->ids) {
+            if (const auto found = s->ids->find(n); found) return found;
+        }
+        if (not s->outer) return s->root->find(n);
+    }
+}
+
+
 /**
  * ## `f5::json::validation::annotations`
  */
 
 
 namespace {
-    void id_handling(
-            f5::json::validation::annotations *anp,
-            std::shared_ptr<f5::json::schema_cache> schemas) {
-        if (anp->sroot[anp->spos].has_key("$id")) {
-            if (not schemas) {
-                schemas =
-                        std::make_shared<f5::json::schema_cache>(anp->schemas);
-                anp->schemas = schemas;
-            }
-            anp->base = &schemas->insert(
-                    f5::json::schema{anp->base->self(), anp->sroot[anp->spos]});
+    /// The `$id`s of the schema are seen before those of the outer scope.
+    /// Most schemas have none, and then the outer scope is used as is.
+    f5::json::validation::scope with_identifiers(
+            const f5::json::validation::scope &outer,
+            const f5::json::schema &s) {
+        if (s.identifiers()) {
+            return f5::json::validation::scope{s, outer};
+        } else {
+            return outer;
         }
     }
-    void definitions(
-            f5::json::validation::annotations *anp,
-            const fostlib::url &base,
-            f5::json::pointer sub) {
-        if (anp->sroot[anp->spos][sub].has_key("definitions")) {
-            for (const auto &def :
-                 anp->sroot[anp->spos][sub]["definitions"].object()) {
-                fostlib::url r{anp->base->self(), anp->spos / sub};
-                const auto &subschema = anp->schemas->insert(
-                        fostlib::string(r.as_string()),
-                        f5::json::schema{base, def.second});
-                definitions(
-                        anp, subschema.self(), sub / "definitions" / def.first);
+    /// If the node has a `$id` then it becomes the new base
+    void id_handling(f5::json::validation::annotations *anp) {
+        if (anp->snode->has_id) {
+            if (const auto found = anp->schemas.find(*anp->snode); found) {
+                anp->base = found;
             }
         }
     }
@@ -50,51 +85,78 @@ namespace {
 
 
 f5::json::validation::annotations::annotations(
-        const json::schema &s, pointer sp, value d, pointer dp)
-: base(&s),
-  sroot(s.assertions()),
-  spos(std::move(sp)),
-  data(std::move(d)),
-  dpos(std::move(dp)),
-  schemas{std::make_shared<schema_cache>()} {
-    id_handling(this, schemas);
-    definitions(this, base->self(), pointer{});
+        const json::schema &s, const value &d)
+: base(&s), snode(&s.root()), data(&d), schemas{s} {
+    id_handling(this);
 }
 
 
 f5::json::validation::annotations::annotations(
-        annotations &an, const json::schema &s, pointer sp, value d, pointer dp)
+        annotations &an,
+        const json::schema &s,
+        const compiled::node &sn,
+        const value &d,
+        path dp)
 : base(&s),
-  sroot(s.assertions()),
-  spos(std::move(sp)),
-  data(std::move(d)),
-  dpos(std::move(dp)),
-  schemas{std::make_shared<schema_cache>(an.schemas)} {
-    id_handling(this, schemas);
-    definitions(this, base->self(), pointer{});
+  snode(&sn),
+  data(&d),
+  dpos(dp),
+  schemas{with_identifiers(an.schemas, s)},
+  errors{an.errors},
+  profiling{an.profiling},
+  memoised{an.memoised},
+  parallelism{an.parallelism},
+  changed{an.changed} {
+    id_handling(this);
 }
 
 
 f5::json::validation::annotations::annotations(
-        annotations &an, pointer sp, pointer dp)
+        annotations &an,
+        const compiled::node &sn,
+        const value &d,
+        path dp)
 : base{an.base},
-  sroot(an.sroot),
-  spos(std::move(sp)),
+  snode(&sn),
+  data(&d),
+  dpos(dp),
+  schemas(an.schemas),
+  errors{an.errors},
+  profiling{an.profiling},
+  memoised{an.memoised},
+  parallelism{an.parallelism},
+  changed{an.changed ? an.changed->at(dp) : nullptr} {
+    id_handling(this);
+}
+
+
+f5::json::validation::annotations::annotations(
+        annotations &an, const compiled::node &sn)
+: base{an.base},
+  snode(&sn),
   data(an.data),
-  dpos(std::move(dp)),
-  schemas(an.schemas) {
-    id_handling(this, nullptr);
+  dpos(an.dpos),
+  schemas(an.schemas),
+  errors{an.errors},
+  profiling{an.profiling},
+  memoised{an.memoised},
+  parallelism{an.parallelism},
+  changed{an.changed} {
+    id_handling(this);
 }
 
 
 f5::json::validation::annotations::annotations(annotations &&b, result &&w)
 : base{b.base},
-  sroot{std::move(b.sroot)},
-  spos{std::move(b.spos)},
-  data{std::move(b.data)},
-  dpos{std::move(b.dpos)},
-  schemas{b.schemas} {
-    id_handling(this, nullptr);
+  snode{b.snode},
+  data{b.data},
+  dpos{b.dpos},
+  schemas{b.schemas},
+  errors{b.errors},
+  profiling{b.profiling},
+  memoised{b.memoised},
+  parallelism{b.parallelism},
+  changed{b.changed} {
     merge(std::move(w));
 }
 
@@ -115,15 +177,9 @@ auto f5::json::validation::annotations::merge(result &&r) -> annotations & {
 }
 
 
-fostlib::url f5::json::validation::annotations::spos_url() const {
-    fostlib::url u{base->self(), pointer{spos.begin(), spos.end()}};
-    for (auto pos = spos.begin(), end = spos.end(); pos != end; ++pos) {
-        pointer from_base{spos.begin(), pos}, to_tip{pos, end};
-        if (sroot[from_base].has_key("$id")) {
-            u = fostlib::url{
-                    u, fostlib::coerce<u8view>(sroot[from_base]["$id"])};
-            u = fostlib::url{u, pointer{pos, end}};
-        }
-    }
-    return u;
+bool f5::json::validation::annotations::record(const result &r) {
+    if (not errors || errors->full()) return false;
+    errors->errors.push_back(std::get<result::error>(r.outcome));
+    return not errors->full();
 }
+
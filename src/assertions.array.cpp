@@ -5,58 +5,100 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/assertions.hpp>
+#include <f5/json/schema.compiled.hpp>
+
+
+namespace {
+    /// Returns `true` if any two items in the array are equal. The items
+    /// are placed in an open addressing hash table and only compared
+    /// when their hashes match.
+    bool has_duplicate(const f5::json::value &array) {
+        const std::size_t count = array.size();
+        if (count < 2) return false;
+        std::size_t capacity{4};
+        while (capacity < count * 2) capacity *= 2;
+        const std::size_t mask = capacity - 1;
+
+        std::vector<std::size_t> hashes(count);
+        /// Holds the index of the item plus one, zero being empty
+        std::vector<std::size_t> slots(capacity);
+        for (std::size_t index{}; index < count; ++index) {
+            const auto &item = array[index];
+            const auto h = hashes[index] = f5::json::compiled::hash(item);
+            for (std::size_t slot = h & mask;; slot = (slot + 1) & mask) {
+                if (not slots[slot]) {
+                    slots[slot] = index + 1;
+                    break;
+                }
+                const auto other = slots[slot] - 1;
+                if (hashes[other] == h && array[other] == item) return true;
+            }
+        }
+        return false;
+    }
+}
 
 
 const f5::json::assertion::checker f5::json::assertion::contains_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            const auto array = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &array = an.current();
             if (array.isarray()) {
-                for (std::size_t index{}; index < array.size(); ++index) {
-                    const auto valid = validation::first_error(
-                            an, an.spos / rule, an.dpos / index);
-                    if (valid) return validation::result{std::move(an)};
+                an.errors = nullptr;
+                an.changed = nullptr;
+                if (validation::any_child(
+                            an, array.size(),
+                            [&](validation::annotations &item,
+                                std::size_t index) {
+                                return validation::first_error(
+                                        item, *rule.subschema, array[index],
+                                        item.dpos / index);
+                            })) {
+                    return validation::result{std::move(an)};
                 }
-                return validation::result{rule, an.spos / rule, an.dpos};
+                return validation::result{rule.name, rule.spos, an.dpos};
             }
             return validation::result{std::move(an)};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::items_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            const auto array = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &array = an.current();
             if (array.isarray()) {
-                if (part.isarray()) {
-                    const auto psize = part.size(), dsize = array.size();
+                if (rule.part.isarray()) {
+                    const auto psize = rule.subschemas.size(),
+                               dsize = array.size();
                     for (std::size_t index{}; index < std::min(psize, dsize);
                          ++index) {
                         auto valid = validation::first_error(
-                                an, an.spos / rule / index, an.dpos / index);
+                                an, *rule.subschemas[index], array[index],
+                                an.dpos / index);
                         if (not valid) return valid;
                         an.merge(std::move(valid));
                     }
-                    if (an.sroot[an.spos].has_key("additionalItems")) {
-                        for (std::size_t index{std::min(psize, dsize)};
-                             index < dsize; ++index) {
-                            auto valid = validation::first_error(
-                                    an, an.spos / "additionalItems",
-                                    an.dpos / index);
-                            if (not valid) return valid;
-                            an.merge(std::move(valid));
-                        }
-                    }
-                } else {
-                    for (std::size_t index{}; index < array.size(); ++index) {
-                        auto valid = validation::first_error(
-                                an, an.spos / rule, an.dpos / index);
+                    if (const auto additional = an.snode->find(
+                                compiled::keyword::additional_items);
+                        additional) {
+                        auto valid = validation::each_child(
+                                an, std::min(psize, dsize), dsize,
+                                [&](validation::annotations &item,
+                                    std::size_t index) {
+                                    return validation::first_error(
+                                            item, *additional->subschema,
+                                            array[index], item.dpos / index);
+                                });
                         if (not valid) return valid;
                         an.merge(std::move(valid));
                     }
+                } else {
+                    return validation::each_child(
+                            std::move(an), 0, array.size(),
+                            [&](validation::annotations &item,
+                                std::size_t index) {
+                                return validation::first_error(
+                                        item, *rule.subschema, array[index],
+                                        item.dpos / index);
+                            });
                 }
             }
             return validation::result{std::move(an)};
@@ -64,15 +106,13 @@ const f5::json::assertion::checker f5::json::assertion::items_checker =
 
 
 const f5::json::assertion::checker f5::json::assertion::max_items_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            value array = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &array = an.current();
             if (array.isarray()) {
-                const auto count = fostlib::coerce<int64_t>(part);
+                const auto count = fostlib::coerce<int64_t>(rule.part);
                 if (array.size() > count) {
                     return validation::result{
-                            rule, an.spos / rule, std::move(an.dpos)};
+                            rule.name, rule.spos, std::move(an.dpos)};
                 }
             }
             return validation::result{std::move(an)};
@@ -80,15 +120,13 @@ const f5::json::assertion::checker f5::json::assertion::max_items_checker =
 
 
 const f5::json::assertion::checker f5::json::assertion::min_items_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            value array = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &array = an.current();
             if (array.isarray()) {
-                const auto count = fostlib::coerce<int64_t>(part);
+                const auto count = fostlib::coerce<int64_t>(rule.part);
                 if (array.size() < count) {
                     return validation::result{
-                            rule, an.spos / rule, std::move(an.dpos)};
+                            rule.name, rule.spos, std::move(an.dpos)};
                 }
             }
             return validation::result{std::move(an)};
@@ -96,26 +134,20 @@ const f5::json::assertion::checker f5::json::assertion::min_items_checker =
 
 
 const f5::json::assertion::checker f5::json::assertion::unique_items_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            value array = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &array = an.current();
             if (array.isarray()) {
-                if (part == fostlib::json(true)) {
-                    std::set<f5::json::value> found;
-                    for (const auto item : array) {
-                        if (found.find(item) != found.end()) {
-                            return validation::result{
-                                    rule, an.spos / rule, an.dpos};
-                        }
-                        found.insert(item);
+                if (rule.part == fostlib::json(true)) {
+                    if (has_duplicate(array)) {
+                        return validation::result{
+                                rule.name, rule.spos, an.dpos};
                     }
-                } else if (part == fostlib::json(false)) {
+                } else if (rule.part == fostlib::json(false)) {
                     return validation::result{std::move(an)};
                 } else {
                     throw fostlib::exceptions::not_implemented(
                             __func__, "unique items -- must be true or false",
-                            part);
+                            rule.part);
                 }
             }
             return validation::result{std::move(an)};
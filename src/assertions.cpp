@@ -5,21 +5,18 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/assertions.hpp>
+#include <f5/json/schema.compiled.hpp>
 
 
 const f5::json::assertion::checker f5::json::assertion::all_of_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (not part.isarray() || part.size() == 0) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (not rule.part.isarray() || rule.part.size() == 0) {
                 throw fostlib::exceptions::not_implemented(
                         __PRETTY_FUNCTION__,
-                        "allOf -- must be a non-empty array", part);
+                        "allOf -- must be a non-empty array", rule.part);
             }
-            for (std::size_t index{}; index < part.size(); ++index) {
-                auto valid = validation::first_error(
-                        an, an.spos / rule / index, an.dpos);
+            for (const auto sub : rule.subschemas) {
+                auto valid = validation::first_error(an, *sub);
                 if (not valid) return valid;
                 an.merge(std::move(valid));
             }
@@ -28,78 +25,83 @@ const f5::json::assertion::checker f5::json::assertion::all_of_checker =
 
 
 const f5::json::assertion::checker f5::json::assertion::any_of_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (not part.isarray() || part.size() == 0) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (not rule.part.isarray() || rule.part.size() == 0) {
                 throw fostlib::exceptions::not_implemented(
                         __PRETTY_FUNCTION__,
-                        "anyOf -- must be a non-empty array", part);
+                        "anyOf -- must be a non-empty array", rule.part);
             }
-            for (std::size_t index{}; index < part.size(); ++index) {
-                const auto valid = validation::first_error(
-                        an, an.spos / rule / index, an.dpos);
-                if (valid) return validation::result{std::move(an)};
+            an.errors = nullptr;
+            an.changed = nullptr;
+            if (rule.choices) {
+                for (const auto index :
+                     rule.choices->candidates(rule, an.current())) {
+                    const auto valid = validation::first_error(
+                            an, *rule.subschemas[index]);
+                    if (valid) return validation::result{std::move(an)};
+                }
+            } else {
+                for (const auto sub : rule.subschemas) {
+                    const auto valid = validation::first_error(an, *sub);
+                    if (valid) return validation::result{std::move(an)};
+                }
             }
-            return validation::result{rule, an.spos, an.dpos};
+            return validation::result{rule.name, an.snode->spos, an.dpos};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::always =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
             return validation::result{std::move(an)};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::const_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (an.data[an.dpos] == part) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (rule.allows(an.current())) {
                 return validation::result{std::move(an)};
             } else {
                 return validation::result{
-                        rule, an.spos / rule, std::move(an.dpos)};
+                        rule.name, rule.spos, std::move(an.dpos)};
             }
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::enum_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (part.isarray()) {
-                const auto value = an.data[an.dpos];
-                for (const auto &opt : part) {
-                    if (value == opt) {
-                        return validation::result{std::move(an)};
-                    }
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (rule.part.isarray()) {
+                if (rule.allows(an.current())) {
+                    return validation::result{std::move(an)};
                 }
             } else {
                 throw fostlib::exceptions::not_implemented(
-                        __PRETTY_FUNCTION__, "enum_checker not array", part);
+                        __PRETTY_FUNCTION__, "enum_checker not array",
+                        rule.part);
             }
-            return validation::result{rule, an.spos / rule, an.dpos};
+            return validation::result{rule.name, rule.spos, an.dpos};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::if_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            auto passed = validation::first_error(an, an.spos / rule, an.dpos);
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            /// Which of `then` and `else` applies can change with the data
+            an.changed = nullptr;
+            auto condition{an};
+            condition.errors = nullptr;
+            auto passed = validation::first_error(
+                    condition, *rule.subschema);
             const bool pflag{passed};
             if (pflag) { an.merge(std::move(passed)); }
-            if (pflag && an.sroot[an.spos].has_key("then")) {
-                auto valid =
-                        validation::first_error(an, an.spos / "then", an.dpos);
+            const auto then = an.snode->find(compiled::keyword::then);
+            const auto otherwise = an.snode->find(compiled::keyword::else_);
+            if (pflag && then) {
+                auto valid = validation::first_error(
+                        an, *then->subschema);
                 if (not valid) return valid;
                 an.merge(std::move(valid));
-            } else if (not pflag && an.sroot[an.spos].has_key("else")) {
-                auto valid =
-                        validation::first_error(an, an.spos / "else", an.dpos);
+            } else if (not pflag && otherwise) {
+                auto valid = validation::first_error(
+                        an, *otherwise->subschema);
                 if (not valid) return valid;
                 an.merge(std::move(valid));
             }
@@ -107,86 +109,100 @@ const f5::json::assertion::checker f5::json::assertion::if_checker =
         };
 
 
-const f5::json::assertion::checker f5::json::assertion::not_checker = [](f5::u8view
-                                                                                 rule,
-                                                                         f5::json::value
-                                                                                 part,
-                                                                         f5::json::validation::annotations
-                                                                                 an) {
-    if (validation::first_error(an, an.spos / rule, an.dpos)) {
-        return validation::result{rule, an.spos / rule, std::move(an.dpos)};
-    } else {
-        return validation::result{std::move(an)};
-    }
-};
+const f5::json::assertion::checker f5::json::assertion::not_checker =
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            an.errors = nullptr;
+            an.changed = nullptr;
+            if (validation::first_error(an, *rule.subschema)) {
+                return validation::result{
+                        rule.name, rule.spos, std::move(an.dpos)};
+            } else {
+                return validation::result{std::move(an)};
+            }
+        };
 
 
 const f5::json::assertion::checker f5::json::assertion::one_of_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (not part.isarray() || part.size() == 0) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (not rule.part.isarray() || rule.part.size() == 0) {
                 throw fostlib::exceptions::not_implemented(
                         __PRETTY_FUNCTION__,
-                        "anyOf -- must be a non-empty array", part);
+                        "anyOf -- must be a non-empty array", rule.part);
             }
+            an.errors = nullptr;
+            an.changed = nullptr;
             std::size_t count{};
-            for (std::size_t index{}; index < part.size();
-                 ++index && count < 2) {
-                auto valid = validation::first_error(
-                        an, an.spos / rule / index, an.dpos);
+            const auto attempt = [&](const compiled::node &sub) {
+                auto valid = validation::first_error(an, sub);
                 if (valid) {
                     an.merge(std::move(valid));
                     ++count;
                 }
+            };
+            /// Stop as soon as a second branch matches
+            if (rule.choices) {
+                const auto &candidates =
+                        rule.choices->candidates(rule, an.current());
+                for (std::size_t c{}; c < candidates.size() && count < 2;
+                     ++c) {
+                    attempt(*rule.subschemas[candidates[c]]);
+                }
+            } else {
+                for (std::size_t index{};
+                     index < rule.subschemas.size() && count < 2; ++index) {
+                    attempt(*rule.subschemas[index]);
+                }
             }
             if (count == 1) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result{rule, an.spos / rule, an.dpos};
+                return validation::result{rule.name, rule.spos, an.dpos};
             }
         };
 
 
-const f5::json::assertion::checker f5::json::assertion::type_checker = [](f5::u8view
-                                                                                  rule,
-                                                                          f5::json::value
-                                                                                  part,
-                                                                          f5::json::validation::annotations
-                                                                                  an) {
-    struct typecheck {
-        f5::u8view type;
-
-        bool operator()(std::monostate) { return type == "null"; }
-        bool operator()(bool) { return type == "boolean"; }
-        bool operator()(double) { return type == "number"; }
-        bool operator()(int64_t) {
-            return type == "integer" || type == "number";
-        }
-        bool operator()(std::shared_ptr<fostlib::string>) {
-            return type == "string";
-        }
-        bool operator()(f5::u8view) { return type == "string"; }
-        bool operator()(fostlib::json::array_p) { return type == "array"; }
-        bool operator()(fostlib::json::object_p) { return type == "object"; }
-    };
-    const auto str = fostlib::coerce<fostlib::nullable<f5::u8view>>(part);
-    if (str) {
-        if (not an.data[an.dpos].apply_visitor(typecheck{str.value()})) {
-            return validation::result{
-                    rule, std::move(an.spos), std::move(an.dpos)};
-        }
-    } else if (part.isarray()) {
-        for (const auto t : part) {
-            const auto str = fostlib::coerce<f5::u8view>(t);
-            if (an.data[an.dpos].apply_visitor(typecheck{str})) {
-                return validation::result{std::move(an)};
+const f5::json::assertion::checker f5::json::assertion::type_checker =
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            struct typecheck {
+                f5::u8view type;
+
+                bool operator()(std::monostate) { return type == "null"; }
+                bool operator()(bool) { return type == "boolean"; }
+                bool operator()(double) { return type == "number"; }
+                bool operator()(int64_t) {
+                    return type == "integer" || type == "number";
+                }
+                bool operator()(std::shared_ptr<fostlib::string>) {
+                    return type == "string";
+                }
+                bool operator()(f5::u8view) { return type == "string"; }
+                bool operator()(fostlib::json::array_p) {
+                    return type == "array";
+                }
+                bool operator()(fostlib::json::object_p) {
+                    return type == "object";
+                }
+            };
+            const auto str =
+                    fostlib::coerce<fostlib::nullable<f5::u8view>>(rule.part);
+            if (str) {
+                if (not an.current().apply_visitor(
+                            typecheck{str.value()})) {
+                    return validation::result{
+                            rule.name, an.snode->spos, std::move(an.dpos)};
+                }
+            } else if (rule.part.isarray()) {
+                for (const auto t : rule.part) {
+                    const auto str = fostlib::coerce<f5::u8view>(t);
+                    if (an.current().apply_visitor(typecheck{str})) {
+                        return validation::result{std::move(an)};
+                    }
+                }
+                return validation::result{
+                        rule.name, an.snode->spos, std::move(an.dpos)};
+            } else {
+                throw fostlib::exceptions::not_implemented(
+                        __PRETTY_FUNCTION__, "type check", rule.part);
             }
-        }
-        return validation::result{rule, std::move(an.spos), std::move(an.dpos)};
-    } else {
-        throw fostlib::exceptions::not_implemented(
-                __PRETTY_FUNCTION__, "type check", part);
-    }
-    return validation::result{std::move(an)};
-};
+            return validation::result{std::move(an)};
+        };
@@ -5,7 +5,7 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/assertions.hpp>
+#include <f5/json/schema.compiled.hpp>
 
 
 namespace {
@@ -20,33 +20,37 @@ namespace {
 
     template<typename P>
     const auto bounds_checker(f5::lstring name, const P p) {
-        return [=](f5::u8view rule, f5::json::value part,
+        return [=](const f5::json::compiled::rule &rule,
                    f5::json::validation::annotations an)
                        -> f5::json::validation::result {
+            const auto &part = rule.part;
             if (const auto bound{part.get<int64_t>()}; bound) {
-                return an.data[an.dpos].apply_visitor(
+                return an.current().apply_visitor(
                         [&](int64_t v) mutable {
                             return p(bound.value(), v)
                                     ? f5::json::validation::result{std::move(an)}
                                     : f5::json::validation::result{
-                                            rule, an.spos, an.dpos};
+                                            rule.name, an.snode->spos,
+                                            an.dpos};
                         },
                         [&](double v) mutable {
                             return p(bound.value(), v)
                                     ? f5::json::validation::result{std::move(an)}
                                     : f5::json::validation::result{
-                                            rule, an.spos, an.dpos};
+                                            rule.name, an.snode->spos,
+                                            an.dpos};
                         },
                         [&](const auto &) mutable {
                             return f5::json::validation::result{std::move(an)};
                         });
             } else if (const auto bound{part.get<double>()}; bound) {
-                return an.data[an.dpos].apply_visitor(
+                return an.current().apply_visitor(
                         [&](int64_t v) mutable {
                             return p(bound.value(), v)
                                     ? f5::json::validation::result{std::move(an)}
                                     : f5::json::validation::result{
-                                            rule, an.spos, an.dpos};
+                                            rule.name, an.snode->spos,
+                                            an.dpos};
                         },
                         [&](double v) mutable {
                             bool passed;
@@ -58,7 +62,8 @@ namespace {
                             return passed
                                     ? f5::json::validation::result{std::move(an)}
                                     : f5::json::validation::result{
-                                            rule, an.spos, an.dpos};
+                                            rule.name, an.snode->spos,
+                                            an.dpos};
                         },
                         [&](const auto &) mutable {
                             return f5::json::validation::result{std::move(an)};
@@ -6,13 +6,13 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
 */
 
-#include <f5/json/assertions.hpp>
+#include <f5/json/schema.compiled.hpp>
 
-#include <regex>
+#include <bitset>
 
 
 namespace {
-    auto property_names(f5::json::value obj) {
+    auto property_names(const f5::json::value &obj) {
         std::set<fostlib::string> names;
         for (const auto &prop : obj.object()) { names.insert(prop.first); }
         return names;
@@ -20,15 +20,24 @@ namespace {
     auto pattern_properties(
             std::set<fostlib::string> &remaining,
             f5::json::validation::annotations an) {
-        const auto patterns = an.sroot[an.spos]["patternProperties"];
-        auto properties = an.data[an.dpos];
-        for (const auto &pattern : patterns.object()) {
-            std::regex re{static_cast<std::string>(pattern.first)};
+        const auto &patterns = *an.snode->find(
+                f5::json::compiled::keyword::pattern_properties);
+        const auto &properties = an.current();
+        for (std::size_t index{}; index < patterns.named.size(); ++index) {
+            const auto &pattern = patterns.named[index];
+            const auto &re = patterns.patterns[index];
+            if (not re) {
+                throw fostlib::exceptions::not_implemented(
+                        __func__,
+                        "The pattern is not a valid regular expression",
+                        f5::json::value{pattern.first});
+            }
             for (const auto &property : properties.object()) {
+                const f5::u8view name{property.first};
                 if (std::regex_search(
-                            static_cast<std::string>(property.first), re)) {
+                            name.data(), name.data() + name.bytes(), *re)) {
                     auto valid = f5::json::validation::first_error(
-                            an, an.spos / "patternProperties" / pattern.first,
+                            an, *pattern.second, property.second,
                             an.dpos / property.first);
                     if (not valid) return valid;
                     an.merge(std::move(valid));
@@ -42,9 +51,12 @@ namespace {
     auto additional_properties(
             const std::set<fostlib::string> &remaining,
             f5::json::validation::annotations an) {
+        const auto &additional = *an.snode->find(
+                f5::json::compiled::keyword::additional_properties);
         for (const auto &pname : remaining) {
             auto valid = f5::json::validation::first_error(
-                    an, an.spos / "additionalProperties", an.dpos / pname);
+                    an, *additional.subschema, an.current()[pname],
+                    an.dpos / pname);
             if (not valid) return valid;
             an.merge(std::move(valid));
         }
@@ -55,22 +67,22 @@ namespace {
 
 const f5::json::assertion::checker
         f5::json::assertion::additional_properties_checker =
-                [](f5::u8view rule,
-                   f5::json::value part,
+                [](const compiled::rule &rule,
                    f5::json::validation::annotations an) {
-                    if (an.sroot[an.spos].has_key("properties")
-                        || an.sroot[an.spos].has_key("patternProperties")) {
+                    if (an.snode->find(compiled::keyword::properties)
+                        || an.snode->find(
+                                compiled::keyword::pattern_properties)) {
                         /// The schema has at least one of the above, so the
                         /// processing of this assertion must happen after and
                         /// as part of the processing of those.
                         return validation::result{std::move(an)};
                     } else {
-                        auto properties = an.data[an.dpos];
+                        const auto &properties = an.current();
                         if (not properties.isobject())
                             return validation::result{std::move(an)};
                         for (const auto &property : properties.object()) {
                             auto valid = validation::first_error(
-                                    an, an.spos / rule,
+                                    an, *rule.subschema, property.second,
                                     an.dpos / property.first);
                             if (not valid) return valid;
                             an.merge(std::move(valid));
@@ -81,27 +93,34 @@ const f5::json::assertion::checker
 
 
 const f5::json::assertion::checker f5::json::assertion::dependencies_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (part.isobject()) {
-                auto properties = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            /// Which dependencies apply can change with the data
+            an.changed = nullptr;
+            if (rule.part.isobject()) {
+                const auto &properties = an.current();
                 if (not properties.isobject())
                     return validation::result{std::move(an)};
                 for (const auto &prop : properties.object()) {
-                    if (part.has_key(prop.first)) {
-                        if (part[prop.first].isarray()) {
-                            for (const auto name : part[prop.first]) {
+                    if (rule.part.has_key(prop.first)) {
+                        const auto &dependency = rule.part[prop.first];
+                        if (dependency.isarray()) {
+                            for (const auto name : dependency) {
                                 if (not properties.has_key(
-                                            fostlib::coerce<f5::u8view>(name))) {
+                                            fostlib::coerce<f5::u8view>(
+                                                    name))) {
                                     return validation::result{
-                                            rule, an.spos / rule / name,
+                                            rule.name, rule.spos / name,
                                             an.dpos};
                                 }
                             }
                         } else {
+                            const auto sub = std::find_if(
+                                    rule.named.begin(), rule.named.end(),
+                                    [&](const auto &n) {
+                                        return n.first == prop.first;
+                                    });
                             auto valid = validation::first_error(
-                                    an, an.spos / rule / prop.first, an.dpos);
+                                    an, *sub->second);
                             if (not valid) return valid;
                             an.merge(std::move(valid));
                         }
@@ -109,54 +128,49 @@ const f5::json::assertion::checker f5::json::assertion::dependencies_checker =
                 }
             } else {
                 throw fostlib::exceptions::not_implemented(
-                        __func__, "dependencies must be an object", part);
+                        __func__, "dependencies must be an object", rule.part);
             }
             return validation::result{std::move(an)};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::max_properties_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            auto properties = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &properties = an.current();
             if (not properties.isobject())
                 return validation::result{std::move(an)};
-            if (properties.size() <= fostlib::coerce<int64_t>(part)) {
+            if (properties.size() <= fostlib::coerce<int64_t>(rule.part)) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result(rule, an.spos / rule, an.dpos);
+                return validation::result(rule.name, rule.spos, an.dpos);
             }
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::min_properties_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            auto properties = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &properties = an.current();
             if (not properties.isobject())
                 return validation::result{std::move(an)};
-            if (properties.size() >= fostlib::coerce<int64_t>(part)) {
+            if (properties.size() >= fostlib::coerce<int64_t>(rule.part)) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result(rule, an.spos / rule, an.dpos);
+                return validation::result(rule.name, rule.spos, an.dpos);
             }
         };
 
 
 const f5::json::assertion::checker
         f5::json::assertion::pattern_properties_checker =
-                [](f5::u8view rule,
-                   f5::json::value part,
+                [](const compiled::rule &rule,
                    f5::json::validation::annotations an) {
-                    if (an.sroot[an.spos].has_key("properties")) {
+                    if (an.snode->find(compiled::keyword::properties)) {
                         /// The schema has a `properties` assertion, in which
                         /// case this assertion will run after that as part of
                         /// the properties checks.
                         return validation::result{std::move(an)};
-                    } else if (an.sroot[an.spos].isobject()) {
-                        auto properties = an.data[an.dpos];
+                    } else if (an.snode->part.isobject()) {
+                        const auto &properties = an.current();
                         if (not properties.isobject())
                             return validation::result{std::move(an)};
                         auto remaining{property_names(properties)};
@@ -164,7 +178,8 @@ const f5::json::assertion::checker
                         if (not valid) return valid;
                         an.merge(std::move(valid));
 
-                        if (an.sroot[an.spos].has_key("additionalProperties")) {
+                        if (an.snode->find(compiled::keyword::
+                                                   additional_properties)) {
                             auto valid = additional_properties(remaining, an);
                             if (not valid) return valid;
                             an.merge(std::move(valid));
@@ -173,63 +188,65 @@ const f5::json::assertion::checker
                         throw fostlib::exceptions::not_implemented(
                                 __func__,
                                 "pattern_properties_checker -- not object",
-                                part);
+                                rule.part);
                     }
                     return validation::result{std::move(an)};
                 };
 
 
 const f5::json::assertion::checker f5::json::assertion::properties_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            if (part.isobject()) {
-                auto properties = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            if (rule.part.isobject()) {
+                const auto &properties = an.current();
                 if (not properties.isobject())
                     return validation::result{std::move(an)};
                 auto remaining{property_names(properties)};
-                const auto rpos = an.spos / rule;
-                for (const auto &p : part.object()) {
+                for (const auto &p : rule.named) {
                     if (properties.has_key(p.first)) {
                         auto v = validation::first_error(
-                                an, rpos / p.first, an.dpos / p.first);
+                                an, *p.second, properties[p.first],
+                                an.dpos / p.first);
                         if (not v) return v;
                         an.merge(std::move(v));
                         auto rit = remaining.find(p.first);
                         if (rit != remaining.end()) remaining.erase(rit);
                     }
                 }
-                if (an.sroot[an.spos].has_key("patternProperties")) {
+                if (an.snode->find(compiled::keyword::pattern_properties)) {
                     auto valid = pattern_properties(remaining, an);
                     if (not valid) return valid;
                     an.merge(std::move(valid));
                 }
-                if (an.sroot[an.spos].has_key("additionalProperties")) {
+                if (an.snode->find(compiled::keyword::additional_properties)) {
                     auto valid = additional_properties(remaining, an);
                     if (not valid) return valid;
                     an.merge(std::move(valid));
                 }
             } else {
                 throw fostlib::exceptions::not_implemented(
-                        __func__, "properties check must be an object", part);
+                        __func__, "properties check must be an object",
+                        rule.part);
             }
             return validation::result{std::move(an)};
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::property_names_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            auto properties = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &properties = an.current();
             if (not properties.isobject())
                 return validation::result{std::move(an)};
-            for (const auto property : properties.object()) {
+            /// A failing name is reported against the object, and names
+            /// aren't part of the data so can't be memoised
+            an.errors = nullptr;
+            an.memoised = nullptr;
+            an.changed = nullptr;
+            for (const auto &property : properties.object()) {
                 auto valid = validation::first_error(validation::annotations{
-                        an, *an.base, an.spos / rule, value(property.first),
-                        pointer{}});
+                        an, *an.base, *rule.subschema, value(property.first),
+                        validation::path{}});
                 if (not valid)
-                    return validation::result{rule, an.spos / rule, an.dpos};
+                    return validation::result{rule.name, rule.spos, an.dpos};
                 an.merge(std::move(valid));
             }
             return validation::result{std::move(an)};
@@ -237,17 +254,208 @@ const f5::json::assertion::checker f5::json::assertion::property_names_checker =
 
 
 const f5::json::assertion::checker f5::json::assertion::required_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
-            const auto obj = an.data[an.dpos];
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
+            const auto &obj = an.current();
             if (obj.isobject()) {
-                for (const auto &check : part) {
+                for (const auto &check : rule.part) {
                     if (not obj.has_key(fostlib::coerce<f5::u8view>(check))) {
                         return validation::result(
-                                rule, an.spos / rule, an.dpos);
+                                rule.name, rule.spos, an.dpos);
                     }
                 }
             }
             return validation::result{std::move(an)};
         };
+
+
+namespace {
+    /// Apply the sub-schemas that apply to a single member of the object.
+    /// Returns the failure, if there is one.
+    std::optional<f5::json::validation::result> member_error(
+            const f5::json::compiled::object_rules &rules,
+            f5::json::validation::annotations &an,
+            const f5::json::value::object_t::value_type &member,
+            const f5::json::compiled::object_rules::key *k) {
+        using namespace f5::json;
+        const f5::u8view name{member.first};
+        bool matched = false;
+        if (k && k->property) {
+            matched = true;
+            auto valid = validation::first_error(
+                    an, *k->property, member.second, an.dpos / member.first);
+            if (not valid) return valid;
+            an.merge(std::move(valid));
+        }
+        if (k && k->dependent_schema) {
+            auto valid = validation::first_error(an, *k->dependent_schema);
+            if (not valid) return valid;
+            an.merge(std::move(valid));
+        }
+        if (const auto patterns = rules.pattern_properties; patterns) {
+            const auto &named = patterns->named;
+            for (std::size_t index{}; index < named.size(); ++index) {
+                if (std::regex_search(
+                            name.data(), name.data() + name.bytes(),
+                            *patterns->patterns[index])) {
+                    matched = true;
+                    auto valid = validation::first_error(
+                            an, *named[index].second, member.second,
+                            an.dpos / member.first);
+                    if (not valid) return valid;
+                    an.merge(std::move(valid));
+                }
+            }
+        }
+        if (rules.additional_properties && not matched) {
+            auto valid = validation::first_error(
+                    an, *rules.additional_properties->subschema,
+                    member.second, an.dpos / member.first);
+            if (not valid) return valid;
+            an.merge(std::move(valid));
+        }
+        if (const auto names = rules.property_names; names) {
+            /// A failing name is reported against the object, and names
+            /// aren't part of the data so can't be memoised
+            const auto errors = std::exchange(an.errors, nullptr);
+            const auto memoised = std::exchange(an.memoised, nullptr);
+            const auto changed = std::exchange(an.changed, nullptr);
+            auto valid = validation::first_error(validation::annotations{
+                    an, *an.base, *names->subschema, value(member.first),
+                    validation::path{}});
+            an.errors = errors;
+            an.memoised = memoised;
+            an.changed = changed;
+            if (not valid) {
+                validation::result failed{names->name, names->spos, an.dpos};
+                if (not an.record(failed)) return failed;
+            }
+        }
+        return {};
+    }
+}
+
+
+namespace {
+    /// The names of an object that have been seen. Nearly every schema
+    /// names few enough members for these to fit in the fixed set, and
+    /// only those that don't use the heap.
+    class seen_names {
+        static constexpr std::size_t fixed = 64;
+        std::bitset<fixed> small;
+        std::vector<bool> large;
+
+      public:
+        explicit seen_names(std::size_t bits) {
+            if (bits > fixed) large.resize(bits);
+        }
+
+        void set(std::size_t bit) {
+            if (large.empty()) {
+                small.set(bit);
+            } else {
+                large[bit] = true;
+            }
+        }
+        bool test(std::size_t bit) const {
+            return large.empty() ? small.test(bit) : bool(large[bit]);
+        }
+    };
+}
+
+
+auto f5::json::compiled::object_rules::check(
+        validation::annotations an) const -> validation::result {
+    const auto &object = an.current();
+    if (not object.isobject()) return validation::result{std::move(an)};
+
+    seen_names seen{bits};
+    const auto found_key = [&](const fostlib::string &name) -> const key * {
+        const auto found = keys.find(name);
+        if (found == keys.end()) return nullptr;
+        const auto &k = found->second;
+        if (k.bit != no_bit) seen.set(k.bit);
+        return &k;
+    };
+    if (an.changed) {
+        /// Only the changed members need to be checked again, but what is
+        /// present is worked out from the schema's names so that members
+        /// that were added or removed are accounted for
+        const auto &changed = an.changed->changed_members();
+        for (const auto &named : keys) {
+            if (not object.has_key(f5::u8view{named.first})) continue;
+            const auto &k = named.second;
+            if (k.bit != no_bit) seen.set(k.bit);
+            /// The dependent schema of an unchanged member passed before,
+            /// but the rest of the object may have changed since
+            if (k.dependent_schema
+                && changed.find(named.first) == changed.end()) {
+                auto valid = validation::first_error(an, *k.dependent_schema);
+                if (not valid) return valid;
+                an.merge(std::move(valid));
+            }
+        }
+        for (const auto &c : changed) {
+            const auto member = object.object().find(c.first);
+            if (member == object.object().end()) continue;
+            const auto found = keys.find(c.first);
+            /// A member that changed completely may be a new one, so
+            /// nothing about it can be assumed
+            const auto changes = an.changed;
+            if (c.second.everything()) an.changed = nullptr;
+            auto failed = member_error(
+                    *this, an, *member,
+                    found == keys.end() ? nullptr : &found->second);
+            an.changed = changes;
+            if (failed) return std::move(*failed);
+        }
+    } else if (validation::in_parallel(an, object.size())) {
+        /// The members are checked on several threads, after which what
+        /// was seen is worked out on this one
+        std::vector<const value::object_t::value_type *> members;
+        members.reserve(object.size());
+        for (const auto &member : object.object()) members.push_back(&member);
+        auto valid = validation::each_child(
+                an, 0, members.size(),
+                [&](validation::annotations &man, std::size_t index) {
+                    const auto &member = *members[index];
+                    const auto found = keys.find(member.first);
+                    if (auto failed = member_error(
+                                *this, man, member,
+                                found == keys.end() ? nullptr
+                                                    : &found->second)) {
+                        return std::move(*failed);
+                    }
+                    return validation::result{man};
+                });
+        if (not valid) return valid;
+        an.merge(std::move(valid));
+        for (const auto &member : object.object()) found_key(member.first);
+    } else {
+        for (const auto &member : object.object()) {
+            if (auto failed = member_error(
+                        *this, an, member, found_key(member.first))) {
+                return std::move(*failed);
+            }
+        }
+    }
+
+    for (const auto &k : dependent) {
+        if (not seen.test(k.first)) continue;
+        for (const auto &d : k.second->depends_on) {
+            if (not seen.test(d.second)) {
+                validation::result failed{
+                        dependencies->name, dependencies->spos / d.first,
+                        an.dpos};
+                if (not an.record(failed)) return failed;
+            }
+        }
+    }
+    for (const auto bit : required_bits) {
+        if (not seen.test(bit)) {
+            validation::result failed{required->name, required->spos, an.dpos};
+            if (not an.record(failed)) return failed;
+            break;
+        }
+    }
+    return validation::result{std::move(an)};
+}
@@ -6,54 +6,52 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
 */
 
-#include <f5/json/assertions.hpp>
-
-#include <regex>
+#include <f5/json/schema.compiled.hpp>
 
 
 const f5::json::assertion::checker f5::json::assertion::max_length_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
             auto string = fostlib::coerce<std::optional<f5::u8view>>(
-                    an.data[an.dpos]);
+                    an.current());
             if (not string) return validation::result{std::move(an)};
-            if (string->code_points() <= fostlib::coerce<int64_t>(part)) {
+            if (string->code_points() <= fostlib::coerce<int64_t>(rule.part)) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result(rule, an.spos / rule, an.dpos);
+                return validation::result(rule.name, rule.spos, an.dpos);
             }
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::min_length_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
             auto string = fostlib::coerce<std::optional<f5::u8view>>(
-                    an.data[an.dpos]);
+                    an.current());
             if (not string) return validation::result{std::move(an)};
-            if (string->code_points() >= fostlib::coerce<int64_t>(part)) {
+            if (string->code_points() >= fostlib::coerce<int64_t>(rule.part)) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result(rule, an.spos / rule, an.dpos);
+                return validation::result(rule.name, rule.spos, an.dpos);
             }
         };
 
 
 const f5::json::assertion::checker f5::json::assertion::pattern_checker =
-        [](f5::u8view rule,
-           f5::json::value part,
-           f5::json::validation::annotations an) {
+        [](const compiled::rule &rule, f5::json::validation::annotations an) {
             auto string = fostlib::coerce<std::optional<f5::u8view>>(
-                    an.data[an.dpos]);
+                    an.current());
             if (not string) return validation::result{std::move(an)};
-            std::regex re{static_cast<std::string>(
-                    fostlib::coerce<fostlib::string>(part))};
+            const auto &re = rule.patterns.front();
+            if (not re) {
+                throw fostlib::exceptions::not_implemented(
+                        __func__,
+                        "The pattern is not a valid regular expression",
+                        rule.part);
+            }
             if (std::regex_search(
-                        string->data(), string->data() + string->bytes(), re)) {
+                        string->data(), string->data() + string->bytes(),
+                        *re)) {
                 return validation::result{std::move(an)};
             } else {
-                return validation::result{rule, an.spos / rule, an.dpos};
+                return validation::result{rule.name, rule.spos, an.dpos};
             }
         };
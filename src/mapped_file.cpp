@@ -0,0 +1,47 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/mapped_file.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+f5::json::mapped_file::mapped_file(const boost::filesystem::path &fn) {
+    fd = ::open(fn.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw fostlib::exceptions::not_implemented(
+                __PRETTY_FUNCTION__, "Could not open file",
+                fostlib::coerce<fostlib::string>(fn));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw fostlib::exceptions::not_implemented(
+                __PRETTY_FUNCTION__, "Could not stat file",
+                fostlib::coerce<fostlib::string>(fn));
+    }
+    bytes = st.st_size;
+    if (bytes) {
+        base = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            ::close(fd);
+            throw fostlib::exceptions::not_implemented(
+                    __PRETTY_FUNCTION__, "Could not map file",
+                    fostlib::coerce<fostlib::string>(fn));
+        }
+        ::madvise(base, bytes, MADV_SEQUENTIAL);
+    }
+}
+
+
+f5::json::mapped_file::~mapped_file() {
+    if (base) ::munmap(base, bytes);
+    ::close(fd);
+}
@@ -0,0 +1,294 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/mapped_file.hpp>
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
+#include <fost/insert>
+
+#include <cstring>
+#include <fstream>
+#include <map>
+
+
+
+/**
+ * ## Schema archives
+ *
+ * An archive starts with a header:
+ *
+ * * The 8 bytes `f5jsarc` (including the terminating zero).
+ * * The format version as a 32 bit number.
+ * * The number `0x01020304`, used to reject files written on a machine
+ *      with a different byte order.
+ * * The number of schemas as a 32 bit number.
+ *
+ * Each schema is then its URL, the number of names it can be found at,
+ * those names, and finally the schema JSON. Strings are a length followed
+ * by the UTF-8 bytes, and numbers are stored in the machine's own format.
+ *
+ * A JSON value is a single tag byte followed by its content: nothing for
+ * `null`, `false` and `true`, 8 bytes for integers and doubles, a string,
+ * or a count followed by that many items (or key and value pairs for
+ * objects).
+ *
+ * Only the JSON is stored. The compiled graphs are full of pointers and
+ * shared ownership, so they are rebuilt from the JSON when an archive is
+ * loaded, and nothing from the file is used once it has been read.
+ *
+ * An archive may have come from anywhere, so every count is checked
+ * against the bytes left in the file before anything is made for it, and
+ * the nesting of the JSON is limited.
+ */
+
+
+namespace {
+
+
+    constexpr char magic[8] = "f5jsarc";
+    constexpr std::uint32_t version = 1;
+    constexpr std::uint32_t byte_order = 0x01020304;
+    /// The deepest nesting of arrays and objects that will be read
+    constexpr std::size_t max_depth = 256;
+
+
+    enum tag : char {
+        null_tag,
+        false_tag,
+        true_tag,
+        integer_tag,
+        double_tag,
+        string_tag,
+        array_tag,
+        object_tag
+    };
+
+
+    class writer {
+        std::ofstream out;
+
+      public:
+        writer(const boost::filesystem::path &fn)
+        : out{fn.string(), std::ios::binary | std::ios::trunc} {
+            if (not out) {
+                throw fostlib::exceptions::not_implemented(
+                        __PRETTY_FUNCTION__, "Could not open archive file",
+                        fostlib::coerce<fostlib::string>(fn));
+            }
+        }
+
+        void bytes(const char *b, std::size_t n) { out.write(b, n); }
+        template<typename N>
+        void number(N n) {
+            out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+        }
+        void string(f5::u8view s) {
+            number(std::uint64_t(s.bytes()));
+            out.write(s.data(), s.bytes());
+        }
+        void json(const f5::json::value &v) {
+            struct visitor {
+                writer &w;
+                void operator()(std::monostate) { w.out.put(null_tag); }
+                void operator()(bool b) {
+                    w.out.put(b ? true_tag : false_tag);
+                }
+                void operator()(int64_t i) {
+                    w.out.put(integer_tag);
+                    w.number(i);
+                }
+                void operator()(double d) {
+                    w.out.put(double_tag);
+                    w.number(d);
+                }
+                void operator()(f5::u8view s) {
+                    w.out.put(string_tag);
+                    w.string(s);
+                }
+                void operator()(std::shared_ptr<fostlib::string> s) {
+                    (*this)(f5::u8view{*s});
+                }
+                void operator()(fostlib::json::array_p a) {
+                    w.out.put(array_tag);
+                    w.number(std::uint64_t(a->size()));
+                    for (const auto &item : *a) w.json(item);
+                }
+                void operator()(fostlib::json::object_p o) {
+                    w.out.put(object_tag);
+                    w.number(std::uint64_t(o->size()));
+                    for (const auto &item : *o) {
+                        w.string(item.first);
+                        w.json(item.second);
+                    }
+                }
+            };
+            v.apply_visitor(visitor{*this});
+        }
+
+        void close(const boost::filesystem::path &fn) {
+            out.close();
+            if (not out) {
+                throw fostlib::exceptions::not_implemented(
+                        __PRETTY_FUNCTION__, "Could not write archive file",
+                        fostlib::coerce<fostlib::string>(fn));
+            }
+        }
+    };
+
+
+    class reader {
+        const char *pos, *const end;
+
+        [[noreturn]] void corrupt(f5::u8view message) {
+            throw fostlib::exceptions::not_implemented(
+                    __PRETTY_FUNCTION__, message);
+        }
+        void need(std::size_t n) {
+            if (std::size_t(end - pos) < n) {
+                corrupt("Archive file is truncated");
+            }
+        }
+
+      public:
+        reader(const f5::json::mapped_file &f)
+        : pos{f.begin()}, end{f.end()} {}
+
+        bool matches(const char *b, std::size_t n) {
+            need(n);
+            const bool same = std::memcmp(pos, b, n) == 0;
+            pos += n;
+            return same;
+        }
+        template<typename N>
+        N number() {
+            need(sizeof(N));
+            N n;
+            std::memcpy(&n, pos, sizeof(N));
+            pos += sizeof(N);
+            return n;
+        }
+        /// Read the number of entries that follow, each of which takes
+        /// at least `least` bytes, making sure that the file can hold them
+        template<typename N>
+        std::size_t count(std::size_t least) {
+            const auto n = number<N>();
+            if (n > std::size_t(end - pos) / least) {
+                corrupt("Archive file has a count larger than the file");
+            }
+            return n;
+        }
+        /// The returned view points into the mapped file
+        f5::u8view string() {
+            const auto bytes = count<std::uint64_t>(1);
+            f5::u8view s{pos, bytes};
+            pos += bytes;
+            return s;
+        }
+        f5::json::value json(std::size_t depth = 0) {
+            need(1);
+            switch (*pos++) {
+            case null_tag: return f5::json::value{};
+            case false_tag: return f5::json::value{false};
+            case true_tag: return f5::json::value{true};
+            case integer_tag: return f5::json::value{number<int64_t>()};
+            case double_tag: return f5::json::value{number<double>()};
+            case string_tag: return f5::json::value{fostlib::string{string()}};
+            case array_tag: {
+                if (depth == max_depth) corrupt("Archive JSON is too deep");
+                /// Each item has at least its tag
+                const auto items = count<std::uint64_t>(1);
+                f5::json::value::array_t a;
+                a.reserve(items);
+                for (std::size_t i{}; i < items; ++i) {
+                    a.push_back(json(depth + 1));
+                }
+                return f5::json::value{std::move(a)};
+            }
+            case object_tag: {
+                if (depth == max_depth) corrupt("Archive JSON is too deep");
+                /// Each member has at least a key length and a tag
+                const auto items =
+                        count<std::uint64_t>(sizeof(std::uint64_t) + 1);
+                f5::json::value::object_t o;
+                for (std::size_t i{}; i < items; ++i) {
+                    fostlib::string key{string()};
+                    o[key] = json(depth + 1);
+                }
+                return f5::json::value{std::move(o)};
+            }
+            default: corrupt("Unknown value tag in archive file");
+            }
+        }
+    };
+
+}
+
+
+std::size_t f5::json::save_schema_archive(const boost::filesystem::path &fn) {
+    /// A schema found at several names (e.g. both its file name and its
+    /// `$id`) is only written once
+    std::map<const compiled::node *,
+             std::pair<const schema *, std::vector<fostlib::string>>>
+            schemas;
+    const auto add = [&](const auto &entries) {
+        for (const auto &e : entries) {
+            auto &found = schemas[&e.second->root()];
+            found.first = e.second;
+            found.second.push_back(e.first);
+        }
+    };
+    add(schema_cache::root_cache()->entries());
+    add(schema_cache::loaded());
+
+    writer out{fn};
+    out.bytes(magic, sizeof(magic));
+    out.number(version);
+    out.number(byte_order);
+    out.number(std::uint32_t(schemas.size()));
+    for (const auto &s : schemas) {
+        out.string(fostlib::coerce<fostlib::string>(s.second.first->self()));
+        out.number(std::uint32_t(s.second.second.size()));
+        for (const auto &name : s.second.second) out.string(name);
+        out.json(s.second.first->assertions());
+    }
+    out.close(fn);
+    return schemas.size();
+}
+
+
+std::size_t f5::json::load_schema_archive(const boost::filesystem::path &fn) {
+    try {
+        const f5::json::mapped_file file{fn};
+        reader in{file};
+        const bool m = in.matches(magic, sizeof(magic));
+        const auto v = in.number<std::uint32_t>();
+        const auto bo = in.number<std::uint32_t>();
+        if (not m || v != version || bo != byte_order) {
+            throw fostlib::exceptions::not_implemented(
+                    __PRETTY_FUNCTION__,
+                    "Not an archive file for this version of the library");
+        }
+        /// Each schema has at least its URL length, a name count and a tag
+        const auto count = in.count<std::uint32_t>(
+                sizeof(std::uint64_t) + sizeof(std::uint32_t) + 1);
+        for (std::size_t i{}; i < count; ++i) {
+            const fostlib::url self{fostlib::url{}, in.string()};
+            std::vector<fostlib::string> names(
+                    in.count<std::uint32_t>(sizeof(std::uint64_t)));
+            for (auto &name : names) name = in.string();
+            const schema s{self, in.json()};
+            for (auto &name : names) {
+                schema_cache::add_loaded(std::move(name), s);
+            }
+        }
+        return count;
+    } catch (fostlib::exceptions::exception &e) {
+        fostlib::insert(
+                e.data(), "archive", fostlib::coerce<fostlib::string>(fn));
+        throw;
+    }
+}
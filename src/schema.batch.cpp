@@ -0,0 +1,60 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <atomic>
+#include <thread>
+
+
+/**
+ * ## Batch validation
+ *
+ * Each thread takes the next document from a shared cursor, so a thread
+ * that gets cheap documents simply takes more of them. This balances the
+ * load without needing a queue per thread. The threads come from the
+ * shared `validation::pool`, so none are started for each batch.
+ */
+
+
+auto f5::json::schema::validate_batch(
+        const std::vector<value> &batch, batch_options options) const
+        -> std::vector<std::optional<validation::result>> {
+    std::vector<std::optional<validation::result>> results(batch.size());
+
+    std::atomic<std::size_t> next{};
+    std::atomic<bool> stop{false};
+    std::mutex exception_mutex;
+    std::exception_ptr exception;
+
+    const auto worker = [&]() {
+        try {
+            while (not stop.load(std::memory_order_relaxed)) {
+                const auto index = next++;
+                if (index >= batch.size()) return;
+                auto result = validate(batch[index]);
+                if (not result && options.stop_on_failure) stop = true;
+                /// The batch may be gone before the results are looked at
+                result.detach();
+                results[index] = std::move(result);
+            }
+        } catch (...) {
+            std::unique_lock<std::mutex> lock{exception_mutex};
+            if (not exception) exception = std::current_exception();
+            stop = true;
+        }
+    };
+
+    std::size_t threads = options.threads
+            ? options.threads
+            : std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min(threads, batch.size());
+    if (threads) validation::pool::shared().run(threads - 1, worker);
+
+    if (exception) std::rethrow_exception(exception);
+    return results;
+}
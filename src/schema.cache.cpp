@@ -11,6 +11,16 @@
 #include <fost/insert>
 #include <fost/push_back>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <future>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <glob.h>
+
 
 const fostlib::setting<f5::json::value> f5::json::c_schema_path(
         __FILE__,
@@ -24,12 +34,16 @@ const fostlib::setting<f5::json::value> f5::json::c_schema_path(
  *
  * Schemas are looked at and loaded in multiple phases.
  *
- * 1. The first is locally within the part of a schema that is currently
- *      being processed. This is handled by the schema cache present in
- *      the [`annotations` structure](../include/f5/json/validator.hpp).
+ * 1. The first is locally within the schemas that are currently being
+ *      processed. Each schema builds an index of its `$id`s when it is
+ *      compiled, and these are chained together by the `scope` in the
+ *      [`annotations` structure](../include/f5/json/validator.hpp).
  * 2. There is a `root_cache` that is populated by the pre-loaded schemas
  *      handled by the file schema loading. This is done when the
- *      `root_schema` is first requested in the code below.
+ *      `root_schema` is first requested in the code below. The schema
+ *      load path setting may be a single entry or an array of them, where
+ *      each entry is a file, a directory or a glob pattern. The files are
+ *      parsed and compiled in parallel.
  * 3. Schemas loaded by the dynamic schema loaders (immediatly below).
  *
  * This ordering ensures that a local schema can only affect validation
@@ -40,14 +54,185 @@ const fostlib::setting<f5::json::value> f5::json::c_schema_path(
 namespace {
 
 
-    auto &g_loader_cache_mutex() {
-        static std::mutex m;
-        return m;
-    }
+    /// A schema that some thread is loading, or has loaded. Only the
+    /// thread that creates the entry loads the schema, any others that
+    /// want the same URL wait for its result.
+    struct loading {
+        loading(f5::u8view u) : url{u}, result{done.get_future().share()} {}
+
+        const fostlib::string url;
+        std::unique_ptr<f5::json::schema> schema;
+        /// Set to the schema, or to `nullptr` if no loader knows the URL.
+        /// If a loader throws then every waiting thread gets its exception
+        std::promise<const f5::json::schema *> done;
+        std::shared_future<const f5::json::schema *> result;
+    };
+
+    /// The loaded schemas are split across several maps, each with its own
+    /// lock, so threads after different URLs don't wait on each other.
+    /// The locks are only held to look up or add an entry, never whilst a
+    /// schema is being loaded.
+    struct shard {
+        std::mutex mutex;
+        std::map<fostlib::string, std::shared_ptr<loading>> loads;
+    };
     auto &g_loader_cache() {
-        static std::map<fostlib::string, std::unique_ptr<f5::json::schema>> c;
+        static std::array<shard, 16> c;
         return c;
     }
+    shard &shard_for(f5::u8view u) {
+        const auto h = std::hash<std::string_view>{}(
+                std::string_view{u.data(), u.bytes()});
+        return g_loader_cache()[h % g_loader_cache().size()];
+    }
+
+
+    /// Entries that have loaded are never removed, so each thread keeps
+    /// its own record of the ones it has already seen. Finding a schema
+    /// again then takes no locks at all.
+    const f5::json::schema &loaded_schema(f5::u8view u) {
+        thread_local std::unordered_map<
+                std::string_view, const f5::json::schema *>
+                seen;
+        if (const auto pos = seen.find(std::string_view{u.data(), u.bytes()});
+            pos != seen.end()) {
+            return *pos->second;
+        }
+
+        auto &s = shard_for(u);
+        std::shared_ptr<loading> l;
+        bool leader = false;
+        {
+            std::unique_lock<std::mutex> lock{s.mutex};
+            if (const auto pos = s.loads.find(u); pos != s.loads.end()) {
+                l = pos->second;
+            } else {
+                l = std::make_shared<loading>(u);
+                s.loads.emplace(l->url, l);
+                leader = true;
+            }
+        }
+        if (leader) {
+            try {
+                l->schema = f5::json::load_schema(u);
+            } catch (...) {
+                /// Forget the attempt so a later lookup can try again
+                {
+                    std::unique_lock<std::mutex> lock{s.mutex};
+                    s.loads.erase(l->url);
+                }
+                l->done.set_exception(std::current_exception());
+                throw;
+            }
+            if (not l->schema) {
+                std::unique_lock<std::mutex> lock{s.mutex};
+                s.loads.erase(l->url);
+            }
+            l->done.set_value(l->schema.get());
+        }
+
+        if (const auto found = l->result.get(); found) {
+            const f5::u8view url{l->url};
+            seen.emplace(std::string_view{url.data(), url.bytes()}, found);
+            return *found;
+        } else {
+            throw fostlib::exceptions::not_implemented(
+                    __PRETTY_FUNCTION__, "Schema not found", u);
+        }
+    }
+
+
+
+
+    /// Add the schema files for one entry in the schema load path. An
+    /// entry can be a file, a directory (whose `.json` files are all
+    /// loaded, including those in sub-directories), or a glob pattern.
+    /// An entry that names something that exists is never expanded as a
+    /// glob, so file names may contain glob characters. An entry that
+    /// matches nothing is an error.
+    /// The files are added in a stable order so that when two of them
+    /// use the same `$id` it is always the same one that is used.
+    void schema_files(
+            f5::u8view entry, std::vector<boost::filesystem::path> &files) {
+        const std::string name{static_cast<std::string>(entry)};
+        if (boost::filesystem::is_directory(name)) {
+            std::vector<boost::filesystem::path> found;
+            for (const auto &f :
+                 boost::filesystem::recursive_directory_iterator(name)) {
+                if (boost::filesystem::is_regular_file(f.path())
+                    && f.path().extension() == ".json") {
+                    found.push_back(f.path());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else if (boost::filesystem::exists(name)) {
+            files.emplace_back(name);
+        } else {
+            ::glob_t found;
+            const auto status = ::glob(name.c_str(), 0, nullptr, &found);
+            if (status == 0) {
+                for (std::size_t i{}; i < found.gl_pathc; ++i) {
+                    files.emplace_back(found.gl_pathv[i]);
+                }
+            }
+            ::globfree(&found);
+            if (status == GLOB_NOMATCH) {
+                throw fostlib::exceptions::not_implemented(
+                        __PRETTY_FUNCTION__,
+                        "Nothing in the schema load path matches", entry);
+            } else if (status != 0) {
+                throw fostlib::exceptions::not_implemented(
+                        __PRETTY_FUNCTION__,
+                        "Could not expand schema load path", entry);
+            }
+        }
+    }
+
+
+    /// Parse and compile the schema files in parallel. The schemas are
+    /// returned in the same order as the files.
+    std::vector<std::optional<f5::json::schema>>
+            compile_files(const std::vector<boost::filesystem::path> &files) {
+        std::vector<std::optional<f5::json::schema>> schemas(files.size());
+
+        std::atomic<std::size_t> next{};
+        std::mutex exception_mutex;
+        std::exception_ptr exception;
+        const auto failed = [&](std::exception_ptr e) {
+            std::unique_lock<std::mutex> lock{exception_mutex};
+            if (not exception) exception = std::move(e);
+            next = files.size();
+        };
+        const auto worker = [&]() {
+            while (true) {
+                const auto index = next++;
+                if (index >= files.size()) return;
+                const auto &fn = files[index];
+                try {
+                    schemas[index].emplace(
+                            fostlib::url{fostlib::url{}, fn},
+                            f5::json::value::parse(
+                                    fostlib::utf::load_file(fn)));
+                } catch (fostlib::exceptions::exception &e) {
+                    fostlib::insert(
+                            e.data(), "schema", "filename",
+                            fostlib::coerce<fostlib::string>(fn));
+                    failed(std::current_exception());
+                } catch (...) { failed(std::current_exception()); }
+            }
+        };
+
+        const std::size_t threads = std::min<std::size_t>(
+                std::max(std::thread::hardware_concurrency(), 1u),
+                files.size());
+        if (threads) {
+            f5::json::validation::pool::shared().run(threads - 1, worker);
+        }
+
+        if (exception) std::rethrow_exception(exception);
+        return schemas;
+    }
 
 
 }
@@ -61,28 +246,34 @@ namespace {
 f5::json::schema_cache::schema_cache() : base(root_cache()) {}
 f5::json::schema_cache::schema_cache(std::shared_ptr<schema_cache> b)
 : base(b) {}
+f5::json::schema_cache::schema_cache(
+        std::shared_ptr<schema_cache> b, std::shared_ptr<const schema_cache> i)
+: base(std::move(b)), index(std::move(i)) {}
 
 
 auto f5::json::schema_cache::root_cache() -> std::shared_ptr<schema_cache> {
     static std::shared_ptr<schema_cache> cache = []() {
         auto cache = std::make_shared<schema_cache>(nullptr);
+        std::vector<boost::filesystem::path> files;
         if (const auto p = fostlib::coerce<std::optional<f5::u8view>>(
                     c_schema_path.value());
             p) {
-            const auto fn = fostlib::coerce<boost::filesystem::path>(
-                    fostlib::string(*p));
-            fostlib::json s{
-                    f5::json::value::parse(fostlib::utf::load_file(fn))};
-            cache->insert(
-                    schema{fostlib::url{fostlib::url{}, fn}, std::move(s)});
+            schema_files(*p, files);
         } else if (c_schema_path.value().isarray()) {
-            for (const auto filepath : c_schema_path.value()) {
-                throw fostlib::exceptions::not_implemented(
-                        "f5::json::schema_cache::root_cache",
-                        "This type of schema load path not yet supported",
-                        c_schema_path.value());
+            for (const auto entry : c_schema_path.value()) {
+                if (const auto p =
+                            fostlib::coerce<std::optional<f5::u8view>>(entry);
+                    p) {
+                    schema_files(*p, files);
+                } else {
+                    throw fostlib::exceptions::not_implemented(
+                            "f5::json::schema_cache::root_cache",
+                            "Schema load path entries must be strings",
+                            entry);
+                }
             }
         }
+        for (auto &s : compile_files(files)) cache->insert(std::move(*s));
         return cache;
     }();
     return cache;
@@ -91,35 +282,28 @@ auto f5::json::schema_cache::root_cache() -> std::shared_ptr<schema_cache> {
 
 auto f5::json::schema_cache::operator[](f5::u8view u) const -> const schema & {
     try {
-        const auto pos = cache.find(u);
-        if (pos == cache.end()) {
+        const auto found = find(u);
+        if (not found) {
             if (base) {
                 return (*base)[u];
             } else {
-                std::unique_lock<std::mutex> lock{g_loader_cache_mutex()};
-                if (auto pos = g_loader_cache().find(u);
-                    pos != g_loader_cache().end()) {
-                    return *pos->second;
-                } else {
-                    auto l = load_schema(u);
-                    if (l) {
-                        return *(
-                                g_loader_cache()[fostlib::string{u}] =
-                                        std::move(l));
-                    } else {
-                        throw fostlib::exceptions::not_implemented(
-                                __PRETTY_FUNCTION__, "Schema not found", u);
-                    }
-                }
+                return loaded_schema(u);
             }
         } else {
-            return pos->second;
+            return *found;
         }
     } catch (fostlib::exceptions::exception &e) {
+        /// A failed load is thrown to every thread that was waiting for
+        /// it, so the same exception can be passing through here on
+        /// several threads at once
+        static std::mutex annotating;
+        std::unique_lock<std::mutex> annotate{annotating};
         if (not e.data().has_key("schema-cache")) {
-            std::unique_lock<std::mutex> lock{g_loader_cache_mutex()};
-            for (const auto &p : g_loader_cache()) {
-                fostlib::push_back(e.data(), "schema-cache", "", p.first);
+            for (auto &s : g_loader_cache()) {
+                std::unique_lock<std::mutex> lock{s.mutex};
+                for (const auto &p : s.loads) {
+                    fostlib::push_back(e.data(), "schema-cache", "", p.first);
+                }
             }
         }
         const fostlib::string cp{std::to_string((int64_t)this)};
@@ -132,6 +316,31 @@ auto f5::json::schema_cache::operator[](f5::u8view u) const -> const schema & {
 }
 
 
+auto f5::json::schema_cache::find(f5::u8view u) const -> const schema * {
+    if (const auto pos = cache.find(u); pos != cache.end()) {
+        return &pos->second;
+    } else if (index) {
+        return index->find(u);
+    } else {
+        return nullptr;
+    }
+}
+
+
+auto f5::json::schema_cache::find(const compiled::node &n) const
+        -> const schema * {
+    if (const auto pos = nodes.find(&n); pos != nodes.end()) {
+        return pos->second;
+    } else if (const auto found = index ? index->find(n) : nullptr; found) {
+        return found;
+    } else if (base) {
+        return base->find(n);
+    } else {
+        return nullptr;
+    }
+}
+
+
 auto f5::json::schema_cache::insert(schema s) -> const schema & {
     if (s.assertions().has_key("$id")) {
         auto parts = fostlib::partition(
@@ -140,6 +349,7 @@ auto f5::json::schema_cache::insert(schema s) -> const schema & {
     }
     auto pos = cache.insert(
             std::make_pair(fostlib::coerce<fostlib::string>(s.self()), s));
+    nodes.insert(std::make_pair(&s.root(), &pos.first->second));
     return pos.first->second;
 }
 
@@ -149,3 +359,55 @@ auto f5::json::schema_cache::insert(fostlib::string n, schema s)
     cache.insert(std::make_pair(n, s));
     return insert(s);
 }
+
+
+auto f5::json::schema_cache::entries() const
+        -> std::vector<std::pair<fostlib::string, const schema *>> {
+    std::vector<std::pair<fostlib::string, const schema *>> found;
+    found.reserve(cache.size());
+    for (const auto &c : cache) found.emplace_back(c.first, &c.second);
+    return found;
+}
+
+
+auto f5::json::schema_cache::loaded()
+        -> std::vector<std::pair<fostlib::string, const schema *>> {
+    std::vector<std::pair<fostlib::string, const schema *>> found;
+    for (auto &s : g_loader_cache()) {
+        std::unique_lock<std::mutex> lock{s.mutex};
+        for (const auto &p : s.loads) {
+            /// Skip those that are still being loaded
+            if (p.second->result.wait_for(std::chrono::seconds{})
+                        == std::future_status::ready
+                && p.second->result.get()) {
+                found.emplace_back(p.first, p.second->result.get());
+            }
+        }
+    }
+    return found;
+}
+
+
+auto f5::json::schema_cache::add_loaded(fostlib::string u, schema s)
+        -> const schema & {
+    auto &sh = shard_for(u);
+    std::shared_ptr<loading> l;
+    {
+        std::unique_lock<std::mutex> lock{sh.mutex};
+        if (const auto pos = sh.loads.find(u); pos != sh.loads.end()) {
+            l = pos->second;
+        } else {
+            l = std::make_shared<loading>(u);
+            l->schema = std::make_unique<schema>(std::move(s));
+            l->done.set_value(l->schema.get());
+            sh.loads.emplace(l->url, l);
+        }
+    }
+    /// Another thread may still be loading it, in which case wait for
+    /// that. If that fails then the archived copy is used after all.
+    if (const auto found = l->result.get(); found) {
+        return *found;
+    } else {
+        return add_loaded(std::move(u), std::move(s));
+    }
+}
@@ -0,0 +1,848 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
+#include <fost/unicode>
+
+#include <algorithm>
+
+
+namespace {
+
+
+    /// Describes how the argument to a keyword is to be compiled
+    enum class argument {
+        /// A plain JSON value, e.g. `maxLength` or `enum`
+        value,
+        /// A single sub-schema, e.g. `not`
+        schema,
+        /// An array of sub-schemas, e.g. `allOf`
+        schemas,
+        /// Either a single sub-schema or an array of them, i.e. `items`
+        schema_or_schemas,
+        /// An object whose values are sub-schemas, e.g. `properties`.
+        /// Array values (as found in `dependencies`) are not schemas.
+        named_schemas,
+    };
+
+
+    struct keyword_info {
+        std::string_view name;
+        f5::json::compiled::keyword id;
+        const f5::json::assertion::checker *check;
+        argument arg;
+        /// A rough measure of how much work the check is. The checks for
+        /// a node are run cheapest first, so that data that is going to
+        /// fail on something simple (e.g. `type`) does so before anything
+        /// that has to look at sub-schemas.
+        ///
+        /// 1. Looks at the value or its size.
+        /// 2. Looks at every character of a string.
+        /// 3. Runs a regular expression or looks at every item.
+        /// 4. Applies sub-schemas to the members or items.
+        /// 5. Applies sub-schemas to the value itself.
+        std::uint8_t cost;
+    };
+    using keyword = f5::json::compiled::keyword;
+
+
+    /// All of the keywords that the compiled graph knows about, in the
+    /// same order as `compiled::keyword` so they can be found both by
+    /// their name (with a binary search when the schema is compiled) and
+    /// by their ID
+    constexpr std::array<keyword_info, f5::json::compiled::keyword_count>
+            g_keywords = {{
+            {"additionalItems", keyword::additional_items,
+             nullptr, argument::schema, 4},
+            {"additionalProperties", keyword::additional_properties,
+             &f5::json::assertion::additional_properties_checker,
+             argument::schema, 4},
+            {"allOf", keyword::all_of,
+             &f5::json::assertion::all_of_checker, argument::schemas, 5},
+            {"anyOf", keyword::any_of,
+             &f5::json::assertion::any_of_checker, argument::schemas, 5},
+            {"const", keyword::const_,
+             &f5::json::assertion::const_checker, argument::value, 1},
+            {"contains", keyword::contains,
+             &f5::json::assertion::contains_checker, argument::schema, 4},
+            {"definitions", keyword::definitions,
+             nullptr, argument::named_schemas, 0},
+            {"dependencies", keyword::dependencies,
+             &f5::json::assertion::dependencies_checker,
+             argument::named_schemas, 4},
+            {"else", keyword::else_, nullptr, argument::schema, 0},
+            {"enum", keyword::enum_,
+             &f5::json::assertion::enum_checker, argument::value, 1},
+            {"exclusiveMaximum", keyword::exclusive_maximum,
+             &f5::json::assertion::exclusive_maximum_checker, argument::value,
+             1},
+            {"exclusiveMinimum", keyword::exclusive_minimum,
+             &f5::json::assertion::exclusive_minimum_checker, argument::value,
+             1},
+            {"if", keyword::if_,
+             &f5::json::assertion::if_checker, argument::schema, 5},
+            {"items", keyword::items,
+             &f5::json::assertion::items_checker, argument::schema_or_schemas,
+             4},
+            {"maxItems", keyword::max_items,
+             &f5::json::assertion::max_items_checker, argument::value, 1},
+            {"maxLength", keyword::max_length,
+             &f5::json::assertion::max_length_checker, argument::value, 2},
+            {"maxProperties", keyword::max_properties,
+             &f5::json::assertion::max_properties_checker, argument::value, 1},
+            {"maximum", keyword::maximum,
+             &f5::json::assertion::maximum_checker, argument::value, 1},
+            {"minItems", keyword::min_items,
+             &f5::json::assertion::min_items_checker, argument::value, 1},
+            {"minLength", keyword::min_length,
+             &f5::json::assertion::min_length_checker, argument::value, 2},
+            {"minProperties", keyword::min_properties,
+             &f5::json::assertion::min_properties_checker, argument::value, 1},
+            {"minimum", keyword::minimum,
+             &f5::json::assertion::minimum_checker, argument::value, 1},
+            {"multipleOf", keyword::multiple_of,
+             &f5::json::assertion::multiple_of_checker, argument::value, 1},
+            {"not", keyword::not_,
+             &f5::json::assertion::not_checker, argument::schema, 5},
+            {"oneOf", keyword::one_of,
+             &f5::json::assertion::one_of_checker, argument::schemas, 5},
+            {"pattern", keyword::pattern,
+             &f5::json::assertion::pattern_checker, argument::value, 3},
+            {"patternProperties", keyword::pattern_properties,
+             &f5::json::assertion::pattern_properties_checker,
+             argument::named_schemas, 4},
+            {"properties", keyword::properties,
+             &f5::json::assertion::properties_checker, argument::named_schemas,
+             4},
+            {"propertyNames", keyword::property_names,
+             &f5::json::assertion::property_names_checker, argument::schema, 4},
+            {"required", keyword::required,
+             &f5::json::assertion::required_checker, argument::value, 1},
+            {"then", keyword::then, nullptr, argument::schema, 0},
+            {"type", keyword::type,
+             &f5::json::assertion::type_checker, argument::value, 1},
+            {"uniqueItems", keyword::unique_items,
+             &f5::json::assertion::unique_items_checker, argument::value, 3},
+    }};
+
+    constexpr bool in_order() {
+        for (std::size_t i{}; i < g_keywords.size(); ++i) {
+            if (std::size_t(g_keywords[i].id) != i) return false;
+            if (i && not(g_keywords[i - 1].name < g_keywords[i].name)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(
+            in_order(),
+            "The keyword table must be sorted and match compiled::keyword");
+
+
+    /// `std::regex` is safe to share between threads once constructed, so
+    /// each pattern is built only once when the schema is compiled
+    std::optional<std::regex> compile_pattern(f5::u8view pattern) {
+        try {
+            return std::regex{pattern.data(), pattern.bytes()};
+        } catch (std::regex_error &) { return {}; }
+    }
+
+
+}
+
+
+/**
+ * ## `f5::json::compiled::node`
+ */
+
+
+namespace {
+    void combine(std::size_t &seed, std::size_t h) {
+        seed ^= h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+    /// The hashes of numbers and strings are mixed with a different
+    /// starting value so that the two types end up in different buckets
+    std::size_t number_hash(double d) {
+        std::size_t seed{0x6e756d};
+        /// `0.0` and `-0.0` compare equal but have different bits
+        combine(seed, d == 0 ? 0 : std::hash<double>{}(d));
+        return seed;
+    }
+    std::size_t string_hash(f5::u8view s) {
+        std::size_t seed{0x737472};
+        combine(seed,
+                std::hash<std::string_view>{}(
+                        std::string_view{s.data(), s.bytes()}));
+        return seed;
+    }
+}
+
+
+std::size_t f5::json::compiled::hash(const value &v) {
+    struct hasher {
+        std::size_t operator()(std::monostate) { return 0x6e756c6c; }
+        std::size_t operator()(bool b) { return b ? 0x74727565 : 0x66616c73; }
+        std::size_t operator()(double d) { return number_hash(d); }
+        std::size_t operator()(int64_t i) { return number_hash(i); }
+        std::size_t operator()(std::shared_ptr<fostlib::string> s) {
+            return string_hash(*s);
+        }
+        std::size_t operator()(f5::u8view s) { return string_hash(s); }
+        std::size_t operator()(fostlib::json::array_p a) {
+            std::size_t seed{a->size()};
+            for (const auto &item : *a) combine(seed, hash(item));
+            return seed;
+        }
+        std::size_t operator()(fostlib::json::object_p o) {
+            std::size_t seed{~o->size()};
+            for (const auto &item : *o) {
+                combine(seed, string_hash(item.first));
+                combine(seed, hash(item.second));
+            }
+            return seed;
+        }
+    };
+    return v.apply_visitor(hasher{});
+}
+
+
+bool f5::json::compiled::rule::allows(const value &v) const {
+    const auto [begin, end] = values.equal_range(hash(v));
+    return std::any_of(
+            begin, end, [&](const auto &opt) { return opt.second == v; });
+}
+
+
+auto f5::json::compiled::find_keyword(u8view name) -> std::optional<keyword> {
+    const std::string_view n{name.data(), name.bytes()};
+    const auto pos = std::lower_bound(
+            g_keywords.begin(), g_keywords.end(), n,
+            [](const auto &k, std::string_view n) { return k.name < n; });
+    if (pos != g_keywords.end() && pos->name == n) {
+        return pos->id;
+    } else {
+        return {};
+    }
+}
+
+
+auto f5::json::compiled::node::find(u8view name) const -> const rule * {
+    if (const auto k = find_keyword(name); k) {
+        return find(*k);
+    } else {
+        return nullptr;
+    }
+}
+
+
+auto f5::json::compiled::node::follow() const -> const link & {
+    std::call_once(target.once, [this]() {
+        if (ref.bytes() && *ref.begin() == '#') {
+            target.local = &owner->at(
+                    fostlib::jcursor::parse_json_pointer_fragment(ref));
+        } else {
+            const auto frag = std::find(ref.begin(), ref.end(), '#');
+            target.url = fostlib::url{owner->url_for(spos),
+                                      u8view{ref.begin(), frag}}
+                                 .as_string();
+            if (frag != ref.end()) {
+                target.fragment = fostlib::jcursor::parse_json_pointer_fragment(
+                        u8view{frag, ref.end()});
+            }
+        }
+    });
+    return target;
+}
+
+
+auto f5::json::compiled::node::external(const validation::scope &scope) const
+        -> std::pair<const schema &, const node &> {
+    const auto &t = follow();
+    const auto within = [&t](const schema &s) -> const node & {
+        if (t.fragment.size()) {
+            return s.root().owner->at(s.root(), t.fragment);
+        } else {
+            return s.root();
+        }
+    };
+    if (const auto found = scope.find(t.url); found) {
+        return {*found, within(*found)};
+    }
+    /// Schemas are never removed from the cache, so what is found there
+    /// the first time can be kept on the node
+    std::call_once(target.cached, [this, &within]() {
+        target.cached_schema = &(*schema_cache::root_cache())[target.url];
+        target.cached_node = &within(*target.cached_schema);
+    });
+    return {*target.cached_schema, *target.cached_node};
+}
+
+
+/**
+ * ## `f5::json::compiled::branches`
+ */
+
+
+namespace {
+
+
+    /// The JSON types in the order used by `branches::by_type`. A double
+    /// is a `number` and an integer is both an `integer` and a `number`.
+    enum json_type : std::uint8_t {
+        null_type,
+        boolean_type,
+        integer_type,
+        number_type,
+        string_type,
+        array_type,
+        object_type
+    };
+    constexpr std::uint8_t all_types = (1 << (object_type + 1)) - 1;
+
+    json_type type_of(const f5::json::value &v) {
+        struct visitor {
+            json_type operator()(std::monostate) { return null_type; }
+            json_type operator()(bool) { return boolean_type; }
+            json_type operator()(double) { return number_type; }
+            json_type operator()(int64_t) { return integer_type; }
+            json_type operator()(std::shared_ptr<fostlib::string>) {
+                return string_type;
+            }
+            json_type operator()(f5::u8view) { return string_type; }
+            json_type operator()(fostlib::json::array_p) { return array_type; }
+            json_type operator()(fostlib::json::object_p) {
+                return object_type;
+            }
+        };
+        return v.apply_visitor(visitor{});
+    }
+
+    /// The types that a value given in `const` or `enum` could match
+    std::uint8_t types_matching(const f5::json::value &v) {
+        switch (const auto t = type_of(v)) {
+        case integer_type:
+        case number_type: return (1 << integer_type) | (1 << number_type);
+        default: return 1 << t;
+        }
+    }
+
+    /// The types named by a `type` keyword, or `all_types` if it is not
+    /// one that is understood
+    std::uint8_t types_named(const f5::json::value &type) {
+        const auto named = [](f5::u8view n) -> std::uint8_t {
+            if (n == "null") return 1 << null_type;
+            if (n == "boolean") return 1 << boolean_type;
+            if (n == "integer") return 1 << integer_type;
+            if (n == "number")
+                return (1 << integer_type) | (1 << number_type);
+            if (n == "string") return 1 << string_type;
+            if (n == "array") return 1 << array_type;
+            if (n == "object") return 1 << object_type;
+            return all_types;
+        };
+        if (const auto n = fostlib::coerce<std::optional<f5::u8view>>(type);
+            n) {
+            return named(*n);
+        } else if (type.isarray()) {
+            std::uint8_t types{};
+            for (const auto &t : type) {
+                const auto n = fostlib::coerce<std::optional<f5::u8view>>(t);
+                if (not n) return all_types;
+                types |= named(*n);
+            }
+            return types;
+        } else {
+            return all_types;
+        }
+    }
+
+    /// Follow local `$ref`s. Returns `nullptr` for anything that leads
+    /// out of the graph or goes round in a loop.
+    const f5::json::compiled::node *
+            resolve(const f5::json::compiled::node *n) {
+        for (std::size_t hops{}; n; ++hops) {
+            if (n->type != f5::json::compiled::node::kind::reference) {
+                return n;
+            } else if (hops > 64) {
+                return nullptr;
+            }
+            n = n->follow().local;
+        }
+        return n;
+    }
+
+    /// The types a node could accept
+    std::uint8_t types_accepted(const f5::json::compiled::node *n) {
+        using kind = f5::json::compiled::node::kind;
+        if (not n || n->type == kind::always || n->type == kind::malformed) {
+            return all_types;
+        } else if (n->type == kind::never) {
+            return 0;
+        }
+        std::uint8_t types{all_types};
+        if (const auto t = n->find(keyword::type); t) {
+            types &= types_named(t->part);
+        }
+        if (const auto c = n->find(keyword::const_); c) {
+            types &= types_matching(c->part);
+        }
+        if (const auto e = n->find(keyword::enum_); e && e->part.isarray()) {
+            std::uint8_t values{};
+            for (const auto &v : e->part) values |= types_matching(v);
+            types &= values;
+        }
+        return types;
+    }
+
+    /// The values a node allows for a property, if it gives a `const` or
+    /// `enum` for it
+    const f5::json::compiled::rule *
+            property_values(const f5::json::compiled::node *n, f5::u8view p) {
+        if (not n || n->type != f5::json::compiled::node::kind::assertions)
+            return nullptr;
+        const auto properties = n->find(keyword::properties);
+        if (not properties) return nullptr;
+        for (const auto &named : properties->named) {
+            if (f5::u8view{named.first} != p) continue;
+            const auto sub = resolve(named.second);
+            if (not sub
+                || sub->type != f5::json::compiled::node::kind::assertions) {
+                return nullptr;
+            } else if (const auto c = sub->find(keyword::const_); c) {
+                return c;
+            } else if (const auto e = sub->find(keyword::enum_);
+                       e && e->part.isarray()) {
+                return e;
+            } else {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    bool requires_property(const f5::json::compiled::node *n, f5::u8view p) {
+        if (const auto r = n->find(keyword::required);
+            r && r->part.isarray()) {
+            for (const auto &name : r->part) {
+                if (fostlib::coerce<std::optional<f5::u8view>>(name) == p) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+}
+
+
+void f5::json::compiled::branches::build(const rule &r) {
+    std::vector<const node *> nodes;
+    std::vector<std::uint8_t> types;
+    for (const auto sub : r.subschemas) {
+        nodes.push_back(resolve(sub));
+        types.push_back(types_accepted(nodes.back()));
+    }
+    for (std::size_t t{}; t < by_type.size(); ++t) {
+        for (std::size_t b{}; b < nodes.size(); ++b) {
+            if (types[b] & (1 << t)) by_type[t].push_back(b);
+        }
+    }
+
+    /// Look for a property that all of the branches accepting an object
+    /// give the allowed values for. The first branch's properties are
+    /// the only possible candidates.
+    const auto &objects = by_type[object_type];
+    if (objects.size() < 2) return;
+    const auto first = nodes[objects.front()];
+    const auto first_properties = first && first->type == node::kind::assertions
+            ? first->find(keyword::properties)
+            : nullptr;
+    if (not first_properties) return;
+    for (const auto &candidate : first_properties->named) {
+        const u8view name{candidate.first};
+        std::vector<const rule *> values;
+        for (const auto b : objects) {
+            if (const auto v = property_values(nodes[b], name); v) {
+                values.push_back(v);
+            } else {
+                break;
+            }
+        }
+        if (values.size() != objects.size()) continue;
+
+        property = candidate.first;
+        for (std::size_t i{}; i < objects.size(); ++i) {
+            const auto b = objects[i];
+            if (not requires_property(nodes[b], name)) without.push_back(b);
+            const auto add = [&](const value &v) {
+                const auto h = hash(v);
+                auto [pos, end] = by_value.equal_range(h);
+                for (; pos != end; ++pos) {
+                    if (pos->second.first == v) break;
+                }
+                if (pos == end) {
+                    pos = by_value.emplace(
+                            h, std::make_pair(v, std::vector<std::size_t>{}));
+                }
+                auto &tried = pos->second.second;
+                if (tried.empty() || tried.back() != b) tried.push_back(b);
+            };
+            if (values[i]->id == keyword::const_) {
+                add(values[i]->part);
+            } else {
+                for (const auto &v : values[i]->part) add(v);
+            }
+        }
+        return;
+    }
+}
+
+
+auto f5::json::compiled::branches::candidates(const rule &r, const value &v)
+        -> const std::vector<std::size_t> & {
+    std::call_once(once, [&]() { build(r); });
+    const auto t = type_of(v);
+    if (t == object_type && property) {
+        if (not v.has_key(*property)) return without;
+        const auto &pv = v[*property];
+        const auto [begin, end] = by_value.equal_range(hash(pv));
+        for (auto pos = begin; pos != end; ++pos) {
+            if (pos->second.first == pv) return pos->second.second;
+        }
+        static const std::vector<std::size_t> none;
+        return none;
+    }
+    return by_type[t];
+}
+
+
+/**
+ * ## `f5::json::compiled::object_rules`
+ */
+
+
+auto f5::json::compiled::object_rules::compile(node &n)
+        -> std::unique_ptr<const object_rules> {
+    auto rules = std::make_unique<object_rules>();
+    std::vector<rule *> fused;
+    for (auto &r : n.rules) {
+        switch (r.id) {
+        case keyword::properties:
+            if (not r.part.isobject()) return nullptr;
+            rules->properties = &r;
+            break;
+        case keyword::pattern_properties:
+            if (not r.part.isobject()) return nullptr;
+            for (const auto &re : r.patterns) {
+                if (not re) return nullptr;
+            }
+            rules->pattern_properties = &r;
+            break;
+        case keyword::additional_properties:
+            rules->additional_properties = &r;
+            break;
+        case keyword::property_names: rules->property_names = &r; break;
+        case keyword::required:
+            if (not r.part.isarray()) return nullptr;
+            for (const auto &name : r.part) {
+                if (not fostlib::coerce<std::optional<u8view>>(name)) {
+                    return nullptr;
+                }
+            }
+            rules->required = &r;
+            break;
+        case keyword::dependencies:
+            if (not r.part.isobject()) return nullptr;
+            for (const auto &d : r.part) {
+                if (not d.isarray()) continue;
+                for (const auto &name : d) {
+                    if (not fostlib::coerce<std::optional<u8view>>(name)) {
+                        return nullptr;
+                    }
+                }
+            }
+            rules->dependencies = &r;
+            break;
+        default: continue;
+        }
+        fused.push_back(&r);
+    }
+    /// Without one of these the members don't need to be walked
+    if (not rules->properties && not rules->pattern_properties
+        && not rules->additional_properties && not rules->property_names
+        && not rules->dependencies) {
+        return nullptr;
+    }
+
+    const auto bit_for = [&rules](u8view name) {
+        auto &k = rules->keys[fostlib::string{name}];
+        if (k.bit == no_bit) k.bit = rules->bits++;
+        return k.bit;
+    };
+    if (rules->properties) {
+        for (const auto &p : rules->properties->named) {
+            rules->keys[p.first].property = p.second;
+        }
+    }
+    if (rules->required) {
+        for (const auto &name : rules->required->part) {
+            rules->required_bits.push_back(
+                    bit_for(fostlib::coerce<u8view>(name)));
+        }
+    }
+    if (rules->dependencies) {
+        for (const auto &d : rules->dependencies->part.object()) {
+            if (d.second.isarray()) {
+                const auto bit = bit_for(d.first);
+                auto &k = rules->keys[d.first];
+                for (const auto &name : d.second) {
+                    k.depends_on.emplace_back(
+                            name, bit_for(fostlib::coerce<u8view>(name)));
+                }
+                rules->dependent.emplace_back(bit, &k);
+            }
+        }
+        for (const auto &d : rules->dependencies->named) {
+            rules->keys[d.first].dependent_schema = d.second;
+        }
+    }
+
+    rules->lead = fused.front();
+    for (auto r : fused) r->fused = true;
+    return rules;
+}
+
+
+/**
+ * ## `f5::json::compiled::graph`
+ */
+
+
+f5::json::compiled::graph::graph(const fostlib::url &b, value s)
+: base{b}, schema_json{std::move(s)} {
+    compile(this, nodes, index, pointer{}, schema_json);
+}
+
+
+auto f5::json::compiled::graph::compile(
+        const graph *owner,
+        std::deque<node> &nodes,
+        std::map<value, const node *> &index,
+        pointer spos,
+        value part) -> node & {
+    /// Nodes are never moved once they are in the `deque` so it is safe
+    /// to keep hold of this reference whilst the children are compiled
+    auto &n = nodes.emplace_back();
+    n.owner = owner;
+    n.spos = std::move(spos);
+    n.part = part;
+    index.emplace(fostlib::coerce<value>(n.spos), &n);
+
+    if (part == value(true)) {
+        n.type = node::kind::always;
+    } else if (part == value(false)) {
+        n.type = node::kind::never;
+    } else if (part.isobject()) {
+        n.type = node::kind::assertions;
+        n.has_id = part.has_key("$id");
+        if (part.has_key("$ref")) {
+            if (const auto ref =
+                        fostlib::coerce<std::optional<u8view>>(part["$ref"]);
+                ref) {
+                n.type = node::kind::reference;
+                n.ref = *ref;
+            } else {
+                n.type = node::kind::malformed;
+            }
+        }
+        /// The rules are compiled even for a `$ref` so that anything they
+        /// contain (e.g. `definitions`) is still part of the graph
+        for (const auto &kw : part.object()) {
+            const auto id = find_keyword(kw.first);
+            if (not id) continue;
+            const auto &info = g_keywords[std::size_t(*id)];
+            rule r;
+            r.name = u8view{info.name.data(), info.name.size()};
+            r.id = *id;
+            r.part = kw.second;
+            r.spos = n.spos / r.name;
+            r.check = info.check;
+            switch (info.arg) {
+            case argument::value: break;
+            case argument::schema_or_schemas:
+                if (r.part.isarray()) {
+                    for (std::size_t i{}; i < r.part.size(); ++i) {
+                        r.subschemas.push_back(&compile(
+                                owner, nodes, index, r.spos / i, r.part[i]));
+                    }
+                    break;
+                }
+                [[fallthrough]];
+            case argument::schema:
+                r.subschema = &compile(owner, nodes, index, r.spos, r.part);
+                break;
+            case argument::schemas:
+                if (r.part.isarray()) {
+                    for (std::size_t i{}; i < r.part.size(); ++i) {
+                        r.subschemas.push_back(&compile(
+                                owner, nodes, index, r.spos / i, r.part[i]));
+                    }
+                }
+                break;
+            case argument::named_schemas:
+                if (r.part.isobject()) {
+                    for (const auto &p : r.part.object()) {
+                        if (p.second.isarray()) continue;
+                        r.named.emplace_back(
+                                p.first,
+                                &compile(
+                                        owner, nodes, index, r.spos / p.first,
+                                        p.second));
+                    }
+                }
+                break;
+            }
+            if (r.id == keyword::pattern) {
+                const auto pattern =
+                        fostlib::coerce<std::optional<u8view>>(r.part);
+                r.patterns.push_back(
+                        pattern ? compile_pattern(*pattern)
+                                : std::optional<std::regex>{});
+            } else if (r.id == keyword::pattern_properties) {
+                for (const auto &p : r.named) {
+                    r.patterns.push_back(compile_pattern(p.first));
+                }
+            } else if (r.id == keyword::enum_ && r.part.isarray()) {
+                for (const auto &opt : r.part) r.values.emplace(hash(opt), opt);
+            } else if (r.id == keyword::const_) {
+                r.values.emplace(hash(r.part), r.part);
+            } else if (
+                    (r.id == keyword::any_of || r.id == keyword::one_of)
+                    && r.subschemas.size() > 1) {
+                r.choices = std::make_unique<branches>();
+            }
+            n.slots[std::size_t(r.id)] = n.rules.size() + 1;
+            n.rules.push_back(std::move(r));
+        }
+        n.object = object_rules::compile(n);
+        for (const auto &r : n.rules) {
+            if (r.check && (not r.fused || &r == n.object->lead)) {
+                n.checks.push_back(&r);
+            }
+        }
+        /// The object rules all run as one check, so that check costs
+        /// as much as the dearest of them
+        std::uint8_t fused_cost{};
+        for (const auto &r : n.rules) {
+            if (r.fused) {
+                fused_cost = std::max(
+                        fused_cost, g_keywords[std::size_t(r.id)].cost);
+            }
+        }
+        const auto cost = [fused_cost](const rule *r) {
+            return r->fused ? fused_cost : g_keywords[std::size_t(r->id)].cost;
+        };
+        std::stable_sort(
+                n.checks.begin(), n.checks.end(),
+                [&cost](const rule *l, const rule *r) {
+                    return cost(l) < cost(r);
+                });
+    } else {
+        n.type = node::kind::malformed;
+    }
+    return n;
+}
+
+
+auto f5::json::compiled::graph::at(const node &from, const pointer &rel) const
+        -> const node & {
+    value::array_t path;
+    for (const auto &p : fostlib::coerce<value>(from.spos)) path.push_back(p);
+    for (const auto &p : fostlib::coerce<value>(rel)) path.push_back(p);
+    const value key{std::move(path)};
+    if (const auto pos = index.find(key); pos != index.end()) {
+        return *pos->second;
+    }
+    /// The position isn't a sub-schema position that was found when the
+    /// graph was compiled, so compile it now and remember it
+    std::unique_lock<std::mutex> lock{late_mutex};
+    if (const auto pos = late_index.find(key); pos != late_index.end()) {
+        return *pos->second;
+    }
+    pointer spos{from.spos};
+    for (const auto &p : fostlib::coerce<value>(rel)) spos = spos / p;
+    return compile(
+            this, late_nodes, late_index, std::move(spos), from.part[rel]);
+}
+
+
+auto f5::json::compiled::graph::reordered(const validation::profile &p) const
+        -> std::shared_ptr<graph> {
+    /// The profile counts the rules of this graph, so each rule in the copy
+    /// is scored using the rule at the same place in the node at the same
+    /// position in this graph. Compiling the same JSON gives the same rules
+    /// in the same order.
+    const auto totals = [&](const node &was, const node &n, const rule *r) {
+        return p.totals(was.rules[r - n.rules.data()]);
+    };
+    /// A check's score is its average time divided by the chance of it
+    /// failing, i.e. what it costs on average to find a failure with it.
+    /// The chance is smoothed so that a check that has never failed
+    /// still gets a score.
+    const auto score = [&](const node &was, const node &n, const rule *r) {
+        const auto t = totals(was, n, r);
+        return double(t.time.count()) / t.calls * (t.calls + 2)
+                / (t.failures + 1);
+    };
+    const auto reorder_node = [&](const node &was, node &n) {
+        /// A check that never ran (because an earlier one failed first)
+        /// has nothing to compare with, so it stays where it is and only
+        /// the checks that ran swap places
+        std::vector<std::size_t> places;
+        std::vector<std::pair<double, const rule *>> scored;
+        for (std::size_t i{}; i < n.checks.size(); ++i) {
+            if (totals(was, n, n.checks[i]).calls) {
+                places.push_back(i);
+                scored.emplace_back(score(was, n, n.checks[i]), n.checks[i]);
+            }
+        }
+        std::stable_sort(
+                scored.begin(), scored.end(),
+                [](const auto &l, const auto &r) { return l.first < r.first; });
+        for (std::size_t i{}; i < places.size(); ++i) {
+            n.checks[places[i]] = scored[i].second;
+        }
+    };
+
+    auto copy = std::make_shared<graph>(base, schema_json);
+    for (auto &n : copy->nodes) {
+        reorder_node(*index.at(fostlib::coerce<value>(n.spos)), n);
+    }
+    /// Nodes compiled since this graph was made are compiled in the copy
+    /// as well, so that they are re-ordered too
+    std::unique_lock<std::mutex> lock{late_mutex};
+    for (const auto &late : late_nodes) copy->at(late.spos);
+    for (auto &n : copy->late_nodes) {
+        reorder_node(*late_index.at(fostlib::coerce<value>(n.spos)), n);
+    }
+    return copy;
+}
+
+
+fostlib::url f5::json::compiled::graph::url_for(const pointer &spos) const {
+    fostlib::url u{base, pointer{spos.begin(), spos.end()}};
+    for (auto pos = spos.begin(), end = spos.end(); pos != end; ++pos) {
+        const auto part = schema_json[pointer{spos.begin(), pos}];
+        if (part.has_key("$id")) {
+            u = fostlib::url{u, fostlib::coerce<u8view>(part["$id"])};
+            u = fostlib::url{u, pointer{pos, end}};
+        }
+    }
+    return u;
+}
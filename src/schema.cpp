@@ -5,23 +5,109 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/schema.hpp>
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
 #include <fost/unicode>
 
 
+namespace {
+    fostlib::string schema_id(const f5::json::value &v) {
+        if (v.has_key("$id")) {
+            return fostlib::coerce<fostlib::string>(v["$id"]);
+        } else {
+            return fostlib::guid();
+        }
+    }
+    void index_identifiers(
+            f5::json::schema_cache &ids,
+            const fostlib::url &base,
+            const f5::json::compiled::node &n) {
+        const auto &b = n.has_id
+                ? ids.insert(f5::json::schema{base, n}).self()
+                : base;
+        for (const auto &r : n.rules) {
+            if (r.subschema) index_identifiers(ids, b, *r.subschema);
+            for (const auto s : r.subschemas) index_identifiers(ids, b, *s);
+            for (const auto &s : r.named) index_identifiers(ids, b, *s.second);
+        }
+    }
+}
+
+
 f5::json::schema::schema(const fostlib::url &b, value v)
-: id{b,
-     [v]() {
-         if (v.has_key("$id")) {
-             return fostlib::coerce<fostlib::string>(v["$id"]);
-         } else {
-             return fostlib::guid();
-         }
-     }()},
-  validation{v} {}
-
-
-auto f5::json::schema::validate(value j) const -> validation::result {
+: id{b, schema_id(v)},
+  validation{v},
+  graph{std::make_shared<compiled::graph>(id, v)},
+  node{&graph->root()} {
+    auto index = std::make_shared<schema_cache>(nullptr);
+    index_identifiers(*index, b, *node);
+    if (not index->empty()) ids = std::move(index);
+}
+
+
+f5::json::schema::schema(const fostlib::url &b, const compiled::node &n)
+: id{b, schema_id(n.part)},
+  validation{n.part},
+  graph{n.owner->shared_from_this()},
+  node{&n} {}
+
+
+void f5::json::schema::reorder(const validation::profile &p) {
+    std::shared_ptr<const compiled::graph> copy = graph->reordered(p);
+    node = &copy->at(node->spos);
+    if (ids) {
+        /// The `$id`s must lead into the new graph as well
+        auto index = std::make_shared<schema_cache>(nullptr);
+        for (const auto &e : ids->entries()) {
+            index->insert(
+                    e.first,
+                    schema{e.second->self(), copy->at(e.second->root().spos)});
+        }
+        ids = std::move(index);
+    }
+    graph = std::move(copy);
+}
+
+
+auto f5::json::schema::validate(const value &j) const -> validation::result {
     return validation::first_error(
-            validation::annotations{*this, pointer{}, j, pointer{}});
+            validation::annotations{*this, j});
+}
+
+
+auto f5::json::schema::validate(const value &j, validation::profile &p) const
+        -> validation::result {
+    validation::annotations an{*this, j};
+    an.profiling = &p;
+    return validation::first_error(std::move(an));
+}
+
+
+auto f5::json::schema::validate(const value &j, validation::memo &m) const
+        -> validation::result {
+    m.clear();
+    validation::annotations an{*this, j};
+    an.memoised = &m;
+    return validation::first_error(std::move(an));
+}
+
+
+auto f5::json::schema::validate(
+        const value &j, const validation::parallel &p) const
+        -> validation::result {
+    validation::annotations an{*this, j};
+    an.parallelism = &p;
+    return validation::first_error(std::move(an));
+}
+
+
+auto f5::json::schema::validate_all(
+        const value &j, std::size_t limit, validation::profile *p) const
+        -> std::vector<validation::result::error> {
+    validation::collector found{{}, std::max(limit, std::size_t{1})};
+    validation::annotations an{*this, j};
+    an.errors = &found;
+    an.profiling = p;
+    validation::first_error(std::move(an));
+    return std::move(found.errors);
 }
@@ -0,0 +1,162 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+
+/**
+ * ## Prefetching
+ *
+ * The schemas are worked through a level at a time. The references in the
+ * schemas at one level are found (which is quick), and then the schemas
+ * they name are loaded in parallel. Those that weren't seen before make
+ * up the next level.
+ *
+ * A reference is resolved in the same way as during validation, i.e.
+ * against the `$id`s of the schemas that lead to it before the root cache
+ * and the loaders, so that what gets loaded is exactly what validation
+ * would have loaded.
+ */
+
+
+namespace {
+
+
+    using cache_ptr = std::shared_ptr<f5::json::schema_cache>;
+
+
+    constexpr std::size_t max_threads = 32;
+
+
+    cache_ptr with_identifiers(cache_ptr schemas, const f5::json::schema &s) {
+        if (s.identifiers()) {
+            return std::make_shared<f5::json::schema_cache>(
+                    std::move(schemas), s.identifiers());
+        } else {
+            return schemas;
+        }
+    }
+
+
+    /// Collect the reference nodes that lead out of the graph
+    void references(
+            const f5::json::compiled::node &n,
+            std::set<const f5::json::compiled::node *> &seen,
+            std::vector<const f5::json::compiled::node *> &found) {
+        if (not seen.insert(&n).second) return;
+        if (n.type == f5::json::compiled::node::kind::reference) {
+            if (const auto &target = n.follow(); target.local) {
+                references(*target.local, seen, found);
+            } else {
+                found.push_back(&n);
+            }
+        }
+        for (const auto &r : n.rules) {
+            if (r.subschema) references(*r.subschema, seen, found);
+            for (const auto s : r.subschemas) references(*s, seen, found);
+            for (const auto &s : r.named) references(*s.second, seen, found);
+        }
+    }
+
+
+    /// A schema whose references are still to be looked at
+    struct pending {
+        const f5::json::schema *schema;
+        cache_ptr schemas;
+    };
+
+
+}
+
+
+auto f5::json::prefetch(const schema &top, std::size_t threads)
+        -> prefetched {
+    prefetched result;
+    std::mutex mutex;
+    std::set<const schema *> scanned{&top};
+    std::set<fostlib::string> available;
+
+    std::vector<pending> level{
+            {&top, with_identifiers(schema_cache::root_cache(), top)}};
+    while (not level.empty()) {
+        struct reference {
+            const compiled::node *node;
+            cache_ptr schemas;
+        };
+        std::vector<reference> refs;
+        for (const auto &p : level) {
+            std::set<const compiled::node *> seen;
+            std::vector<const compiled::node *> found;
+            references(p.schema->root(), seen, found);
+            for (const auto n : found) refs.push_back({n, p.schemas});
+        }
+
+        std::vector<pending> next;
+        std::atomic<std::size_t> cursor{};
+        const auto worker = [&]() {
+            while (true) {
+                const auto index = cursor++;
+                if (index >= refs.size()) return;
+                const auto &ref = refs[index];
+                const auto &target = ref.node->follow();
+                try {
+                    const auto &loaded = (*ref.schemas)[target.url];
+                    if (target.fragment.size()) {
+                        const auto &root = loaded.root();
+                        if (root.owner->at(root, target.fragment).type
+                            == compiled::node::kind::malformed) {
+                            throw fostlib::exceptions::not_implemented(
+                                    __func__,
+                                    "The reference is not to a schema",
+                                    fostlib::coerce<value>(target.fragment));
+                        }
+                    }
+                    std::unique_lock<std::mutex> lock{mutex};
+                    if (available.insert(target.url).second) {
+                        result.schemas.push_back(target.url);
+                    }
+                    if (scanned.insert(&loaded).second) {
+                        next.push_back(
+                                {&loaded,
+                                 with_identifiers(ref.schemas, loaded)});
+                    }
+                } catch (std::exception &e) {
+                    std::unique_lock<std::mutex> lock{mutex};
+                    result.unresolved.emplace_back(
+                            ref.node->ref, fostlib::string{e.what()});
+                }
+            }
+        };
+
+        /// Loading mostly waits on I/O, so by default every reference at
+        /// this level gets its own thread. These are started here rather
+        /// than taken from `validation::pool`, which is sized for
+        /// validation and would otherwise be kept this large, with its
+        /// threads stuck waiting on loads.
+        const std::size_t count =
+                std::min(threads ? threads : max_threads, refs.size());
+        std::vector<std::thread> helpers;
+        try {
+            for (std::size_t t{1}; t < count; ++t) {
+                helpers.emplace_back(worker);
+            }
+            if (count) worker();
+        } catch (...) {
+            for (auto &t : helpers) t.join();
+            throw;
+        }
+        for (auto &t : helpers) t.join();
+
+        level = std::move(next);
+    }
+    return result;
+}
@@ -0,0 +1,394 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <algorithm>
+
+
+/**
+ * ## `f5::json::validation::changes`
+ */
+
+
+f5::json::validation::changes::changes(const std::vector<pointer> &ps) {
+    for (const auto &p : ps) add(p);
+}
+
+
+void f5::json::validation::changes::add(const pointer &p) {
+    auto *here = this;
+    for (const auto &part : fostlib::coerce<value>(p)) {
+        if (here->whole) return;
+        if (const auto name = fostlib::coerce<std::optional<u8view>>(part);
+            name) {
+            here = &here->below[fostlib::string{*name}];
+        } else {
+            here = &here->below[fostlib::string{
+                    std::to_string(fostlib::coerce<int64_t>(part))}];
+        }
+    }
+    here->whole = true;
+    here->below.clear();
+}
+
+
+auto f5::json::validation::changes::at(const path &child) const
+        -> const changes * {
+    static const changes none;
+    const auto found = child.kind == path::step::key
+            ? below.find(fostlib::string{child.key})
+            : below.find(fostlib::string{std::to_string(child.index)});
+    if (found == below.end()) {
+        return &none;
+    } else if (found->second.whole) {
+        return nullptr;
+    } else {
+        return &found->second;
+    }
+}
+
+
+auto f5::json::validation::changes::changed_items() const
+        -> std::vector<std::size_t> {
+    std::vector<std::size_t> indexes;
+    for (const auto &b : below) {
+        const f5::u8view name{b.first};
+        if (name.bytes()
+            && std::all_of(name.begin(), name.end(), [](auto c) {
+                   return c >= '0' && c <= '9';
+               })) {
+            indexes.push_back(
+                    std::stoull(std::string{name.data(), name.bytes()}));
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
+
+
+/**
+ * ## JSON Patch
+ *
+ * Each operation builds a new document. Only the arrays and objects on the
+ * path to the position are copied, and as their items are shared they are
+ * not deep copies.
+ *
+ * Inserting into or removing from an array moves every item after the
+ * position, so all of those positions are recorded as changed.
+ */
+
+
+namespace {
+
+
+    using f5::json::pointer;
+    using f5::json::value;
+
+
+    [[noreturn]] void bad_patch(f5::u8view message, const value &op) {
+        throw fostlib::exceptions::not_implemented(
+                __PRETTY_FUNCTION__, message, op);
+    }
+
+
+    pointer position(const value &op, f5::u8view field) {
+        const auto p = fostlib::coerce<std::optional<f5::u8view>>(op[field]);
+        if (not p) bad_patch("The operation needs a JSON pointer", op);
+        return fostlib::jcursor::parse_json_pointer_string(*p);
+    }
+
+
+    /// The `value` of an operation, which must be present
+    const value &value_of(const value &op) {
+        if (not op.has_key("value")) {
+            bad_patch("The operation needs a value", op);
+        }
+        return op["value"];
+    }
+
+
+    fostlib::string name_of(const value &part) {
+        if (const auto name = fostlib::coerce<std::optional<f5::u8view>>(part);
+            name) {
+            return fostlib::string{*name};
+        } else {
+            return fostlib::string{
+                    std::to_string(fostlib::coerce<int64_t>(part))};
+        }
+    }
+
+
+    /// The array index for a part of a path. The end of the array (which
+    /// may be written as `-`) is only allowed when adding.
+    std::size_t index_of(
+            const value &part,
+            std::size_t size,
+            bool adding,
+            const value &op) {
+        std::size_t index = size;
+        if (const auto name = fostlib::coerce<std::optional<f5::u8view>>(part);
+            name) {
+            if (*name != "-") {
+                if (not name->bytes()
+                    || not std::all_of(
+                            name->begin(), name->end(), [](auto c) {
+                                return c >= '0' && c <= '9';
+                            })) {
+                    bad_patch("The array index is not a number", op);
+                }
+                index = std::stoull(std::string{name->data(), name->bytes()});
+            }
+        } else {
+            index = fostlib::coerce<int64_t>(part);
+        }
+        if (index > size || (index == size && not adding)) {
+            bad_patch("The array index is past the end of the array", op);
+        }
+        return index;
+    }
+
+
+    /// The value at the position, or `nullptr` if there isn't one
+    const value *find(const value &doc, const pointer &p, const value &op) {
+        const value *here = &doc;
+        for (const auto &part : fostlib::coerce<value>(p)) {
+            if (here->isobject()) {
+                const auto name = name_of(part);
+                if (not here->has_key(name)) return nullptr;
+                here = &(*here)[name];
+            } else if (here->isarray()) {
+                const auto index = index_of(part, here->size(), false, op);
+                here = &(*here)[index];
+            } else {
+                return nullptr;
+            }
+        }
+        return here;
+    }
+
+
+    /// Returns a copy of `doc` where the array or object holding the last
+    /// part of the path has been replaced by what `alter` returns for it
+    template<typename F>
+    value altered(
+            const value &doc,
+            const value &parts,
+            std::size_t pos,
+            const value &op,
+            F alter) {
+        if (pos + 1 == parts.size()) return alter(doc, parts[pos]);
+        if (doc.isobject()) {
+            const auto name = name_of(parts[pos]);
+            if (not doc.has_key(name)) {
+                bad_patch("The position's parent does not exist", op);
+            }
+            value::object_t object{doc.object()};
+            object[name] = altered(doc[name], parts, pos + 1, op, alter);
+            return value{std::move(object)};
+        } else if (doc.isarray()) {
+            const auto index = index_of(parts[pos], doc.size(), false, op);
+            value::array_t array;
+            for (const auto &item : doc) array.push_back(item);
+            array[index] = altered(doc[index], parts, pos + 1, op, alter);
+            return value{std::move(array)};
+        } else {
+            bad_patch("The position's parent is not an array or object", op);
+        }
+    }
+
+
+    /// Record the items from `index` to the end as changed
+    void moved(
+            f5::json::validation::changes &changed,
+            const pointer &p,
+            std::size_t index,
+            std::size_t end) {
+        const pointer array{p.begin(), std::prev(p.end())};
+        for (; index < end; ++index) {
+            auto item{array};
+            item /= index;
+            changed.add(item);
+        }
+    }
+
+
+    value add(
+            value doc,
+            const pointer &p,
+            value v,
+            const value &op,
+            f5::json::validation::changes &changed) {
+        if (p.size() == 0) {
+            changed.add(p);
+            return v;
+        }
+        return altered(
+                doc, fostlib::coerce<value>(p), 0, op,
+                [&](const value &container, const value &last) {
+                    if (container.isobject()) {
+                        value::object_t object{container.object()};
+                        object[name_of(last)] = v;
+                        changed.add(p);
+                        return value{std::move(object)};
+                    } else if (container.isarray()) {
+                        const auto index =
+                                index_of(last, container.size(), true, op);
+                        value::array_t array;
+                        for (const auto &item : container) {
+                            array.push_back(item);
+                        }
+                        array.insert(array.begin() + index, v);
+                        moved(changed, p, index, array.size());
+                        return value{std::move(array)};
+                    } else {
+                        bad_patch("Can only add to an array or object", op);
+                    }
+                });
+    }
+
+
+    value remove(
+            value doc,
+            const pointer &p,
+            const value &op,
+            f5::json::validation::changes &changed) {
+        if (p.size() == 0) {
+            bad_patch("The whole document cannot be removed", op);
+        }
+        return altered(
+                doc, fostlib::coerce<value>(p), 0, op,
+                [&](const value &container, const value &last) {
+                    if (container.isobject()) {
+                        const auto name = name_of(last);
+                        if (not container.has_key(name)) {
+                            bad_patch("There is nothing to remove", op);
+                        }
+                        value::object_t object{container.object()};
+                        object.erase(name);
+                        changed.add(p);
+                        return value{std::move(object)};
+                    } else if (container.isarray()) {
+                        const auto index =
+                                index_of(last, container.size(), false, op);
+                        value::array_t array;
+                        for (const auto &item : container) {
+                            array.push_back(item);
+                        }
+                        array.erase(array.begin() + index);
+                        moved(changed, p, index, container.size());
+                        return value{std::move(array)};
+                    } else {
+                        bad_patch("There is nothing to remove", op);
+                    }
+                });
+    }
+
+
+    value replace(
+            value doc,
+            const pointer &p,
+            value v,
+            const value &op,
+            f5::json::validation::changes &changed) {
+        if (not find(doc, p, op)) bad_patch("There is nothing to replace", op);
+        if (p.size() == 0) {
+            changed.add(p);
+            return v;
+        }
+        return altered(
+                doc, fostlib::coerce<value>(p), 0, op,
+                [&](const value &container, const value &last) {
+                    if (container.isobject()) {
+                        value::object_t object{container.object()};
+                        object[name_of(last)] = v;
+                        changed.add(p);
+                        return value{std::move(object)};
+                    } else {
+                        const auto index =
+                                index_of(last, container.size(), false, op);
+                        value::array_t array;
+                        for (const auto &item : container) {
+                            array.push_back(item);
+                        }
+                        array[index] = v;
+                        changed.add(p);
+                        return value{std::move(array)};
+                    }
+                });
+    }
+
+
+}
+
+
+auto f5::json::apply_patch(
+        value doc, const value &patch, validation::changes &changed)
+        -> value {
+    if (not patch.isarray()) {
+        bad_patch("A JSON Patch must be an array of operations", patch);
+    }
+    for (const auto &op : patch) {
+        const auto name = fostlib::coerce<std::optional<u8view>>(op["op"]);
+        if (not name) bad_patch("The operation has no `op`", op);
+        const auto path = position(op, "path");
+        if (*name == "add") {
+            doc = add(std::move(doc), path, value_of(op), op, changed);
+        } else if (*name == "remove") {
+            doc = remove(std::move(doc), path, op, changed);
+        } else if (*name == "replace") {
+            doc = replace(std::move(doc), path, value_of(op), op, changed);
+        } else if (*name == "move" || *name == "copy") {
+            const auto from = position(op, "from");
+            const auto found = find(doc, from, op);
+            if (not found) bad_patch("There is nothing to move or copy", op);
+            const value v{*found};
+            if (*name == "move") {
+                if (path.size() > from.size()
+                    && pointer{path.begin(), path.begin() + from.size()}
+                            == from) {
+                    bad_patch("A value cannot be moved into itself", op);
+                }
+                doc = remove(std::move(doc), from, op, changed);
+            }
+            doc = add(std::move(doc), path, v, op, changed);
+        } else if (*name == "test") {
+            const auto found = find(doc, path, op);
+            if (not found || *found != value_of(op)) {
+                bad_patch("The test operation failed", op);
+            }
+        } else {
+            bad_patch("Unknown JSON Patch operation", op);
+        }
+    }
+    return doc;
+}
+
+
+/**
+ * ## `f5::json::schema::revalidate`
+ */
+
+
+auto f5::json::schema::revalidate(
+        const value &after, const validation::changes &changed) const
+        -> validation::result {
+    validation::annotations an{*this, after};
+    an.changed = changed.everything() ? nullptr : &changed;
+    return validation::first_error(std::move(an));
+}
+
+
+auto f5::json::schema::revalidate(value before, const value &patch) const
+        -> std::pair<value, validation::result> {
+    validation::changes changed;
+    auto after = apply_patch(std::move(before), patch, changed);
+    auto result = revalidate(after, changed);
+    /// `after` is moved into the pair, so the result mustn't refer to it
+    result.detach();
+    return {std::move(after), std::move(result)};
+}
@@ -5,53 +5,12 @@
     See <http://www.boost.org/LICENSE_1_0.txt>
  */
 
-#include <f5/json/assertions.hpp>
 #include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.compiled.hpp>
 #include <fost/push_back>
 #include <fost/unicode>
 
-
-namespace {
-
-
-    const auto g_assertions = []() {
-        std::map<f5::u8view, f5::json::assertion::checker> a;
-        a["additionalProperties"] =
-                f5::json::assertion::additional_properties_checker;
-        a["allOf"] = f5::json::assertion::all_of_checker;
-        a["anyOf"] = f5::json::assertion::any_of_checker;
-        a["const"] = f5::json::assertion::const_checker;
-        a["contains"] = f5::json::assertion::contains_checker;
-        a["dependencies"] = f5::json::assertion::dependencies_checker;
-        a["enum"] = f5::json::assertion::enum_checker;
-        a["exclusiveMaximum"] = f5::json::assertion::exclusive_maximum_checker;
-        a["exclusiveMinimum"] = f5::json::assertion::exclusive_minimum_checker;
-        a["if"] = f5::json::assertion::if_checker;
-        a["items"] = f5::json::assertion::items_checker;
-        a["maximum"] = f5::json::assertion::maximum_checker;
-        a["maxItems"] = f5::json::assertion::max_items_checker;
-        a["maxLength"] = f5::json::assertion::max_length_checker;
-        a["maxProperties"] = f5::json::assertion::max_properties_checker;
-        a["minimum"] = f5::json::assertion::minimum_checker;
-        a["minItems"] = f5::json::assertion::min_items_checker;
-        a["minLength"] = f5::json::assertion::min_length_checker;
-        a["minProperties"] = f5::json::assertion::min_properties_checker;
-        a["multipleOf"] = f5::json::assertion::multiple_of_checker;
-        a["not"] = f5::json::assertion::not_checker;
-        a["oneOf"] = f5::json::assertion::one_of_checker;
-        a["pattern"] = f5::json::assertion::pattern_checker;
-        a["patternProperties"] =
-                f5::json::assertion::pattern_properties_checker;
-        a["properties"] = f5::json::assertion::properties_checker;
-        a["propertyNames"] = f5::json::assertion::property_names_checker;
-        a["required"] = f5::json::assertion::required_checker;
-        a["type"] = f5::json::assertion::type_checker;
-        a["uniqueItems"] = f5::json::assertion::unique_items_checker;
-        return a;
-    }();
-
-
-}
+#include <algorithm>
 
 
 /**
@@ -79,75 +38,219 @@ f5::json::validation::result::operator error() && {
 }
 
 
+void f5::json::validation::result::detach() {
+    if (const auto an = std::get_if<annotations>(&outcome); an) {
+        static const value nothing;
+        an->data = &nothing;
+    }
+}
+
+
 /**
  * ## `f5::json::validation::first_error`
  */
 
 
+namespace {
+    using namespace f5::json::validation;
+
+
+    /// Apply the target of a `$ref`. Without references the schema is a
+    /// tree, so this is the only place the same sub-schema can be reached
+    /// again for the same data, and the only place the memo is needed.
+    result referenced(annotations an) {
+        if (not an.memoised || an.errors) return first_error(std::move(an));
+        auto &m = *an.memoised;
+        const auto &node = *an.snode;
+        const auto &data = *an.data;
+        if (const auto found = m.find(node, data); found) {
+            if (*found) {
+                const auto &e = **found;
+                return result{
+                        e.assertion, e.spos, an.dpos.as_pointer() / e.dpos};
+            } else {
+                return result{std::move(an)};
+            }
+        }
+        const auto dpos = an.dpos;
+        auto outcome = first_error(std::move(an));
+        m.remember(node, data, dpos, outcome);
+        return outcome;
+    }
+
+
+}
+
+
 auto f5::json::validation::first_error(annotations an) -> result {
+    /// The node passed this data before and none of it has changed since
+    if (an.changed && an.changed->unchanged()) return result{std::move(an)};
     try {
-        if (an.sroot[an.spos] == fostlib::json(true)) {
-            return result{std::move(an)};
-        } else if (an.sroot[an.spos] == fostlib::json(false)) {
-            return result{"false", std::move(an.spos), std::move(an.dpos)};
-        } else if (auto part = an.sroot[an.spos]; part.isobject()) {
-            if (part.has_key("$ref")) {
-                const auto ref = fostlib::coerce<f5::u8view>(part["$ref"]);
-                if (ref.bytes() && *ref.begin() == '#') {
-                    auto valid = first_error(
-                            an,
-                            fostlib::jcursor::parse_json_pointer_fragment(
-                                    fostlib::coerce<f5::u8view>(part["$ref"])),
-                            an.dpos);
-                    if (not valid)
-                        return valid;
-                    else
-                        return annotations(std::move(an), std::move(valid));
-                } else {
-                    const auto &cache = *an.schemas;
-                    if (const auto frag =
-                                std::find(ref.begin(), ref.end(), '#');
-                        frag == ref.end()) {
-                        const fostlib::url u{an.spos_url(), ref};
-                        const auto &ref_schema = cache[u.as_string()];
-                        auto valid = first_error(annotations{
-                                an, ref_schema, pointer{}, an.data, an.dpos});
-                        if (not valid) return valid;
-                        return annotations{std::move(an), std::move(valid)};
-                    } else {
-                        const f5::u8view us{ref.begin(), frag};
-                        const fostlib::url u{an.spos_url(), us};
-                        const auto &ref_schema = cache[u.as_string()];
-                        auto valid = first_error(annotations{
-                                an, ref_schema,
-                                fostlib::jcursor::parse_json_pointer_fragment(
-                                        f5::u8view{frag, ref.end()}),
-                                an.data, an.dpos});
-                        if (not valid) return valid;
-                        return annotations(std::move(an), std::move(valid));
-                    }
-                }
+        const auto &node = *an.snode;
+        const profile::timer timing{an.profiling, node};
+        switch (node.type) {
+        case compiled::node::kind::always: return result{std::move(an)};
+        case compiled::node::kind::never: {
+            result failed{"false", node.spos, an.dpos};
+            if (an.record(failed)) return result{std::move(an)};
+            return failed;
+        }
+        case compiled::node::kind::reference: {
+            const auto &target = node.follow();
+            if (target.local) {
+                auto valid = referenced(annotations{an, *target.local});
+                if (not valid)
+                    return valid;
+                else
+                    return annotations(std::move(an), std::move(valid));
             } else {
-                for (const auto &rule : part.object()) {
-                    const auto apos = g_assertions.find(rule.first);
-                    if (apos != g_assertions.end()) {
-                        auto v = apos->second(apos->first, rule.second, an);
-                        if (not v) return v;
-                        an.merge(std::move(v));
-                    }
+                const auto [ref_schema, ref_node] = node.external(an.schemas);
+                auto valid = referenced(annotations{
+                        an, ref_schema, ref_node, *an.data, an.dpos});
+                if (not valid) return valid;
+                return annotations{std::move(an), std::move(valid)};
+            }
+        }
+        case compiled::node::kind::assertions:
+            for (const auto rule : node.checks) {
+                const profile::timer timing{an.profiling, *rule};
+                auto v = rule->fused ? node.object->check(an)
+                                     : (*rule->check)(*rule, an);
+                if (not v) {
+                    timing.failed();
+                    if (not an.record(v)) return v;
+                } else {
+                    an.merge(std::move(v));
                 }
             }
-        } else {
+            return result{std::move(an)};
+        case compiled::node::kind::malformed:
             throw fostlib::exceptions::not_implemented(
-                    __func__, "A schema must be a boolean or an object", part);
+                    __func__, "A schema must be a boolean or an object",
+                    node.part);
         }
         return result{std::move(an)};
     } catch (fostlib::exceptions::exception &e) {
         fostlib::json::object_t proc;
         proc["base"] = fostlib::coerce<fostlib::json>(an.base->self());
-        proc["spos"] = fostlib::coerce<fostlib::json>(an.spos);
-        proc["dpos"] = fostlib::coerce<fostlib::json>(an.dpos);
+        proc["spos"] = fostlib::coerce<fostlib::json>(an.snode->spos);
+        proc["dpos"] = fostlib::coerce<fostlib::json>(an.dpos.as_pointer());
         fostlib::push_back(e.data(), "first_error stack", proc);
         throw;
     }
 }
+
+
+/**
+ * ## `f5::json::validation::memo`
+ */
+
+
+auto f5::json::validation::memo::find(
+        const compiled::node &n, const value &v) const
+        -> const std::optional<result::error> * {
+    if (const auto pos = outcomes.find({&n, &v}); pos != outcomes.end()) {
+        return &pos->second;
+    } else {
+        return nullptr;
+    }
+}
+
+
+void f5::json::validation::memo::remember(
+        const compiled::node &n,
+        const value &v,
+        const path &at,
+        const result &r) {
+    if (const auto e = std::get_if<result::error>(&r.outcome); e) {
+        outcomes.emplace(
+                std::make_pair(&n, &v),
+                result::error{
+                        e->assertion, e->spos,
+                        pointer{e->dpos.begin() + at.depth(),
+                                e->dpos.end()}});
+    } else {
+        outcomes.emplace(std::make_pair(&n, &v), std::nullopt);
+    }
+}
+
+
+/**
+ * ## `f5::json::validation::profile`
+ */
+
+
+auto f5::json::validation::profile::keywords() const
+        -> std::map<fostlib::string, counter> {
+    std::map<fostlib::string, counter> totals;
+    for (const auto &r : rules) {
+        auto &total = totals[r.first->name];
+        total.calls += r.second.calls;
+        total.failures += r.second.failures;
+        total.time += r.second.time;
+    }
+    return totals;
+}
+
+
+auto f5::json::validation::profile::locations() const
+        -> std::vector<location> {
+    std::vector<location> found;
+    found.reserve(nodes.size() + rules.size());
+    for (const auto &n : nodes) {
+        found.push_back(location{n.first->spos, {}, n.second});
+    }
+    for (const auto &r : rules) {
+        found.push_back(location{r.first->spos, r.first->name, r.second});
+    }
+    std::stable_sort(
+            found.begin(), found.end(), [](const auto &l, const auto &r) {
+                return l.total.time > r.total.time;
+            });
+    return found;
+}
+
+
+auto f5::json::validation::profile::totals(const compiled::rule &r) const
+        -> counter {
+    if (const auto pos = rules.find(&r); pos != rules.end()) {
+        return pos->second;
+    } else {
+        return {};
+    }
+}
+
+
+void f5::json::validation::profile::clear() {
+    nodes.clear();
+    rules.clear();
+}
+
+
+/**
+ * ## `f5::json::validation::path`
+ */
+
+
+std::size_t f5::json::validation::path::depth() const {
+    std::size_t steps{};
+    for (auto p = this; p->kind != step::root; p = p->parent) ++steps;
+    return steps;
+}
+
+
+auto f5::json::validation::path::as_pointer() const -> pointer {
+    std::vector<const path *> steps;
+    for (auto p = this; p->kind != step::root; p = p->parent) {
+        steps.push_back(p);
+    }
+    pointer found;
+    for (auto s = steps.rbegin(); s != steps.rend(); ++s) {
+        if ((*s)->kind == step::key) {
+            found /= fostlib::string{(*s)->key};
+        } else {
+            found /= (*s)->index;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,276 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/validator.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+
+/**
+ * ## `f5::json::validation::pool`
+ *
+ * Each call to `run` queues a request for helpers. An idle thread takes
+ * the request at the front of the queue and runs its job. Once the job
+ * has finished on the calling thread the request is withdrawn, so any
+ * helpers that haven't started by then never will, and only those that
+ * have started are waited for. A thread in the pool can therefore call
+ * `run` itself without the risk of waiting for help that never comes.
+ */
+
+
+namespace {
+
+
+    struct request {
+        request(const std::function<void()> &j, std::size_t h)
+        : job{j}, wanted{h} {}
+
+        const std::function<void()> &job;
+        /// The number of helpers that may still start
+        std::size_t wanted;
+        /// The number of helpers that are running the job
+        std::size_t running = 0;
+        bool withdrawn = false;
+        std::exception_ptr exception;
+        std::condition_variable finished;
+    };
+
+
+}
+
+
+struct f5::json::validation::pool::state {
+    std::mutex mutex;
+    std::condition_variable work;
+    std::deque<request *> queue;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    void help() {
+        std::unique_lock<std::mutex> lock{mutex};
+        while (true) {
+            work.wait(lock, [this]() { return stopping || not queue.empty(); });
+            if (stopping) return;
+            auto &r = *queue.front();
+            if (--r.wanted == 0) queue.pop_front();
+            ++r.running;
+            lock.unlock();
+            std::exception_ptr exception;
+            try {
+                r.job();
+            } catch (...) { exception = std::current_exception(); }
+            lock.lock();
+            if (exception && not r.exception) r.exception = exception;
+            if (--r.running == 0 && r.withdrawn) r.finished.notify_all();
+        }
+    }
+};
+
+
+f5::json::validation::pool::pool() : self{std::make_unique<state>()} {}
+
+
+f5::json::validation::pool::~pool() {
+    {
+        std::unique_lock<std::mutex> lock{self->mutex};
+        self->stopping = true;
+    }
+    self->work.notify_all();
+    for (auto &t : self->threads) t.join();
+}
+
+
+auto f5::json::validation::pool::shared() -> pool & {
+    static pool p;
+    return p;
+}
+
+
+void f5::json::validation::pool::run(
+        std::size_t helpers, const std::function<void()> &job) {
+    /// The calling thread is one of the threads working on the job, so
+    /// the pool never needs more than one fewer than the hardware has
+    helpers = std::min<std::size_t>(
+            helpers, std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    request r{job, 0};
+    if (helpers) {
+        std::unique_lock<std::mutex> lock{self->mutex};
+        try {
+            while (self->threads.size() < helpers) {
+                self->threads.emplace_back([s = self.get()]() { s->help(); });
+            }
+        } catch (std::system_error &) {
+            /// Make do with the threads that could be started
+        }
+        r.wanted = std::min(helpers, self->threads.size());
+        if (r.wanted) self->queue.push_back(&r);
+    }
+    if (r.wanted) self->work.notify_all();
+
+    std::exception_ptr exception;
+    try {
+        job();
+    } catch (...) { exception = std::current_exception(); }
+
+    if (helpers) {
+        std::unique_lock<std::mutex> lock{self->mutex};
+        r.withdrawn = true;
+        if (r.wanted) {
+            self->queue.erase(
+                    std::find(self->queue.begin(), self->queue.end(), &r));
+        }
+        r.finished.wait(lock, [&r]() { return r.running == 0; });
+        if (not exception) exception = r.exception;
+    }
+    if (exception) std::rethrow_exception(exception);
+}
+
+
+/**
+ * ## Checking children on several threads
+ *
+ * `each_child` and `any_child` both look for the lowest index whose check
+ * settles the outcome: a failure for `each_child` and a pass for
+ * `any_child`. An exception also settles it, so that what is thrown is
+ * what checking on a single thread would have thrown.
+ *
+ * The threads take chunks of children in index order, so once an index
+ * has settled the outcome every chunk that starts after it can be skipped.
+ * The chunks before it are still finished, as one of them may hold a
+ * lower index that settles the outcome.
+ */
+
+
+namespace {
+
+
+    using namespace f5::json::validation;
+
+
+    std::size_t thread_count(const parallel &options) {
+        return options.threads
+                ? options.threads
+                : std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+
+    /// Returns the result of the check at the lowest index that settles the
+    /// outcome, if there is one. Annotations from the checks are not kept.
+    std::optional<result> lowest_settling(
+            const annotations &an,
+            std::size_t begin,
+            std::size_t end,
+            const child_check &check,
+            bool settled_by_pass) {
+        const std::size_t chunk =
+                std::max(an.parallelism->chunk, std::size_t{1});
+        std::atomic<std::size_t> next{begin}, settled{end};
+        std::mutex mutex;
+        std::optional<result> outcome;
+        std::exception_ptr exception;
+
+        const auto worker = [&]() {
+            annotations local{an};
+            local.parallelism = nullptr;
+            local.memoised = nullptr;
+            while (true) {
+                const auto start = next.fetch_add(chunk);
+                if (start >= settled.load()) return;
+                const auto last = std::min(start + chunk, end);
+                for (auto index = start; index < last && index < settled.load();
+                     ++index) {
+                    try {
+                        auto checked = check(local, index);
+                        if (bool(checked) == settled_by_pass) {
+                            std::unique_lock<std::mutex> lock{mutex};
+                            if (index < settled.load()) {
+                                settled = index;
+                                outcome.emplace(std::move(checked));
+                                exception = nullptr;
+                            }
+                            return;
+                        }
+                    } catch (...) {
+                        std::unique_lock<std::mutex> lock{mutex};
+                        if (index < settled.load()) {
+                            settled = index;
+                            outcome.reset();
+                            exception = std::current_exception();
+                        }
+                        return;
+                    }
+                }
+            }
+        };
+
+        const std::size_t threads = std::min(
+                thread_count(*an.parallelism),
+                (end - begin + chunk - 1) / chunk);
+        pool::shared().run(threads - 1, worker);
+
+        if (exception) std::rethrow_exception(exception);
+        return outcome;
+    }
+
+
+}
+
+
+bool f5::json::validation::in_parallel(
+        const annotations &an, std::size_t count) {
+    return an.parallelism && not an.errors && not an.profiling
+            && not an.memoised && count > 1
+            && count >= an.parallelism->threshold
+            && thread_count(*an.parallelism) > 1;
+}
+
+
+auto f5::json::validation::each_child(
+        annotations an,
+        std::size_t begin,
+        std::size_t end,
+        const child_check &check) -> result {
+    if (an.changed) {
+        for (const auto index : an.changed->changed_items()) {
+            if (index < begin) continue;
+            if (index >= end) break;
+            auto valid = check(an, index);
+            if (not valid) return valid;
+            an.merge(std::move(valid));
+        }
+    } else if (begin < end && in_parallel(an, end - begin)) {
+        if (auto failed = lowest_settling(an, begin, end, check, false);
+            failed) {
+            return std::move(*failed);
+        }
+    } else {
+        for (std::size_t index{begin}; index < end; ++index) {
+            auto valid = check(an, index);
+            if (not valid) return valid;
+            an.merge(std::move(valid));
+        }
+    }
+    return result{std::move(an)};
+}
+
+
+bool f5::json::validation::any_child(
+        annotations &an, std::size_t count, const child_check &check) {
+    if (in_parallel(an, count)) {
+        return lowest_settling(an, 0, count, check, true).has_value();
+    } else {
+        for (std::size_t index{}; index < count; ++index) {
+            if (check(an, index)) return true;
+        }
+        return false;
+    }
+}
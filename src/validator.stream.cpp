@@ -0,0 +1,707 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.compiled.hpp>
+#include <f5/json/validator.stream.hpp>
+#include <fost/insert>
+#include <fost/unicode>
+
+#include <istream>
+
+
+namespace {
+
+
+    using node_list = std::vector<const f5::json::compiled::node *>;
+    using keyword = f5::json::compiled::keyword;
+
+
+    enum class container { object, array };
+
+
+    /// How a keyword is handled when it applies to an object or array
+    enum class handling {
+        /// The keyword never fails for this sort of value
+        ignore,
+        /// The keyword can be checked as the members arrive
+        stream,
+        /// The keyword needs the whole value
+        build
+    };
+
+
+    handling handle(keyword k, container c) {
+        const bool object = c == container::object;
+        switch (k) {
+        case keyword::additional_properties:
+        case keyword::max_properties:
+        case keyword::min_properties:
+        case keyword::pattern_properties:
+        case keyword::properties:
+        case keyword::property_names:
+        case keyword::required:
+            return object ? handling::stream : handling::ignore;
+        case keyword::items:
+        case keyword::max_items:
+        case keyword::min_items:
+            return object ? handling::ignore : handling::stream;
+        case keyword::contains:
+        case keyword::unique_items:
+            return object ? handling::ignore : handling::build;
+        case keyword::all_of:
+        case keyword::type: return handling::stream;
+        case keyword::dependencies:
+            return object ? handling::build : handling::ignore;
+        case keyword::exclusive_maximum:
+        case keyword::exclusive_minimum:
+        case keyword::maximum:
+        case keyword::max_length:
+        case keyword::minimum:
+        case keyword::min_length:
+        case keyword::multiple_of:
+        case keyword::pattern: return handling::ignore;
+        default: return handling::build;
+        }
+    }
+
+
+    /// Returns an empty result if the `type` can't be worked out without
+    /// the checker
+    std::optional<bool>
+            type_allows(const f5::json::value &type, f5::u8view name) {
+        if (const auto t = fostlib::coerce<std::optional<f5::u8view>>(type);
+            t) {
+            return *t == name;
+        } else if (type.isarray()) {
+            for (const auto &t : type) {
+                const auto s = fostlib::coerce<std::optional<f5::u8view>>(t);
+                if (not s) return {};
+                if (*s == name) return true;
+            }
+            return false;
+        } else {
+            return {};
+        }
+    }
+
+
+    /// Both of these are taken from the
+    /// [JSON specification](https://tools.ietf.org/html/rfc8259)
+    bool is_whitespace(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    bool is_digit(int c) { return c >= '0' && c <= '9'; }
+
+
+}
+
+
+/**
+ * ## `f5::json::validation::stream`
+ */
+
+
+struct f5::json::validation::stream::state {
+    state(const json::schema &s) : schema{s}, root{s, checking} {}
+
+    const json::schema &schema;
+    /// The complete value that `root` is currently checking
+    value checking;
+    annotations root;
+    std::optional<result::error> error;
+    bool complete = false;
+
+    /// An object or array whose members are being checked as they arrive
+    struct frame {
+        container type;
+        pointer dpos;
+        node_list nodes;
+        std::size_t count = 0;
+        fostlib::string key;
+        /// For each `required` the names that haven't yet been seen
+        using names = std::set<fostlib::string>;
+        std::vector<std::pair<const compiled::rule *, names>> missing;
+    };
+    std::vector<frame> frames;
+
+    /// An object or array that is being built so it can be checked once
+    /// it is complete
+    struct part {
+        container type;
+        value::array_t array;
+        value::object_t object;
+        fostlib::string key;
+    };
+    std::vector<part> building;
+    node_list building_nodes;
+    pointer building_dpos;
+
+
+    void fail(u8view assertion, pointer spos, pointer dpos) {
+        if (error) return;
+        error = result::error{assertion, std::move(spos), std::move(dpos)};
+    }
+    void fail(const pointer &dpos, result::error e) {
+        if (error) return;
+        /// The data position in the error is relative to `dpos`
+        pointer p{dpos};
+        for (const auto &pos : fostlib::coerce<value>(e.dpos)) p = p / pos;
+        e.dpos = std::move(p);
+        error = std::move(e);
+    }
+
+
+    /// Check a complete value against the nodes using the normal
+    /// validation
+    void check(const node_list &nodes, value v, const pointer &dpos) {
+        checking = std::move(v);
+        for (const auto n : nodes) {
+            auto valid = first_error(root, *n);
+            if (not valid) {
+                fail(dpos, static_cast<result::error>(std::move(valid)));
+                return;
+            }
+        }
+    }
+
+
+    /// Work out which nodes apply to the next value in the current
+    /// container
+    node_list next() {
+        if (frames.empty()) {
+            if (complete) {
+                throw fostlib::exceptions::not_implemented(
+                        __func__,
+                        "The streaming validator has already seen a whole "
+                        "JSON value");
+            }
+            return {&schema.root()};
+        }
+        auto &top = frames.back();
+        node_list children;
+        if (top.type == container::object) {
+            const u8view name{top.key};
+            for (const auto n : top.nodes) {
+                bool matched = false;
+                if (const auto props = n->find(keyword::properties); props) {
+                    for (const auto &p : props->named) {
+                        if (p.first == top.key) {
+                            children.push_back(p.second);
+                            matched = true;
+                        }
+                    }
+                }
+                if (const auto pats = n->find(keyword::pattern_properties);
+                    pats) {
+                    for (std::size_t i{}; i < pats->named.size(); ++i) {
+                        const auto &re = pats->patterns[i];
+                        if (not re) {
+                            throw fostlib::exceptions::not_implemented(
+                                    __func__,
+                                    "The pattern is not a valid regular "
+                                    "expression",
+                                    value{pats->named[i].first});
+                        }
+                        if (std::regex_search(
+                                    name.data(), name.data() + name.bytes(),
+                                    *re)) {
+                            children.push_back(pats->named[i].second);
+                            matched = true;
+                        }
+                    }
+                }
+                if (const auto additional =
+                            n->find(keyword::additional_properties);
+                    additional && not matched) {
+                    children.push_back(additional->subschema);
+                }
+            }
+        } else {
+            const auto index = top.count++;
+            for (const auto n : top.nodes) {
+                if (const auto items = n->find(keyword::items); items) {
+                    if (items->subschema) {
+                        children.push_back(items->subschema);
+                    } else if (index < items->subschemas.size()) {
+                        children.push_back(items->subschemas[index]);
+                    } else if (const auto additional =
+                                       n->find(keyword::additional_items);
+                               additional) {
+                        children.push_back(additional->subschema);
+                    }
+                }
+                if (const auto max = n->find(keyword::max_items);
+                    max && top.count > fostlib::coerce<int64_t>(max->part)) {
+                    fail(max->name, max->spos, top.dpos);
+                }
+            }
+        }
+        return children;
+    }
+    pointer next_dpos() const {
+        if (frames.empty()) {
+            return pointer{};
+        } else if (frames.back().type == container::object) {
+            return frames.back().dpos / frames.back().key;
+        } else {
+            return frames.back().dpos / (frames.back().count - 1);
+        }
+    }
+
+
+    /// Add a node for an object or array to the list of ones to stream.
+    /// Returns `false` if the value has to be built instead.
+    bool expand(const compiled::node &n, container c, node_list &into) {
+        switch (n.type) {
+        case compiled::node::kind::always: return true;
+        case compiled::node::kind::never:
+            fail("false", n.spos, next_dpos());
+            return true;
+        case compiled::node::kind::reference:
+            if (const auto &target = n.follow(); target.local) {
+                return expand(*target.local, c, into);
+            } else {
+                return false;
+            }
+        case compiled::node::kind::malformed: return false;
+        case compiled::node::kind::assertions: break;
+        }
+        for (const auto &rule : n.rules) {
+            if (not rule.check) continue;
+            switch (handle(rule.id, c)) {
+            case handling::ignore: break;
+            case handling::build: return false;
+            case handling::stream:
+                if (rule.id == keyword::all_of) {
+                    for (const auto sub : rule.subschemas) {
+                        if (not expand(*sub, c, into)) return false;
+                    }
+                } else if (rule.id == keyword::type) {
+                    const auto allowed = type_allows(
+                            rule.part,
+                            c == container::object ? "object" : "array");
+                    if (not allowed) return false;
+                    if (not *allowed) fail(rule.name, n.spos, next_dpos());
+                }
+                break;
+            }
+        }
+        into.push_back(&n);
+        return true;
+    }
+
+
+    /// Start an object or array
+    void start(container c) {
+        if (error) return;
+        if (not building.empty()) {
+            building.push_back(part{c, {}, {}, {}});
+            return;
+        }
+        const auto nodes = next();
+        if (error) return;
+        auto dpos = next_dpos();
+        node_list streamed;
+        for (const auto n : nodes) {
+            if (not expand(*n, c, streamed)) {
+                building.push_back(part{c, {}, {}, {}});
+                building_nodes = nodes;
+                building_dpos = std::move(dpos);
+                return;
+            }
+        }
+        frame f{c, std::move(dpos), std::move(streamed)};
+        for (const auto n : f.nodes) {
+            if (c != container::object) break;
+            if (const auto required = n->find(keyword::required); required) {
+                frame::names names;
+                for (const auto &name : required->part) {
+                    names.insert(fostlib::coerce<fostlib::string>(name));
+                }
+                f.missing.emplace_back(required, std::move(names));
+            }
+        }
+        frames.push_back(std::move(f));
+    }
+    /// End an object or array
+    void end() {
+        if (error) return;
+        if (not building.empty()) {
+            auto p = std::move(building.back());
+            building.pop_back();
+            if (p.type == container::object) {
+                done(value{std::move(p.object)});
+            } else {
+                done(value{std::move(p.array)});
+            }
+            return;
+        } else if (frames.empty()) {
+            throw fostlib::exceptions::not_implemented(
+                    __func__, "End of an object or array without a start");
+        }
+        auto f = std::move(frames.back());
+        frames.pop_back();
+        for (const auto &m : f.missing) {
+            if (not m.second.empty()) {
+                fail(m.first->name, m.first->spos, f.dpos);
+                return;
+            }
+        }
+        for (const auto n : f.nodes) {
+            const auto min = n->find(
+                    f.type == container::object ? keyword::min_properties
+                                                : keyword::min_items);
+            if (min && f.count < fostlib::coerce<int64_t>(min->part)) {
+                fail(min->name, min->spos, f.dpos);
+                return;
+            }
+        }
+        if (frames.empty()) complete = true;
+    }
+    /// A scalar, or an object or array that has been built
+    void done(value v) {
+        if (error) return;
+        if (not building.empty()) {
+            auto &top = building.back();
+            if (top.type == container::object) {
+                top.object[top.key] = std::move(v);
+            } else {
+                top.array.push_back(std::move(v));
+            }
+        } else if (building_nodes.size()) {
+            check(building_nodes, std::move(v), building_dpos);
+            building_nodes.clear();
+            if (frames.empty()) complete = true;
+        } else {
+            const auto nodes = next();
+            check(nodes, std::move(v), next_dpos());
+            if (frames.empty()) complete = true;
+        }
+    }
+};
+
+
+f5::json::validation::stream::stream(const schema &s)
+: self{std::make_unique<state>(s)} {}
+f5::json::validation::stream::~stream() = default;
+
+
+void f5::json::validation::stream::start_object() {
+    self->start(container::object);
+}
+void f5::json::validation::stream::key(u8view k) {
+    if (self->error) return;
+    if (not self->building.empty()) {
+        self->building.back().key = fostlib::string{k};
+        return;
+    } else if (self->frames.empty()) {
+        throw fostlib::exceptions::not_implemented(
+                __PRETTY_FUNCTION__, "Object key outside of an object");
+    }
+    auto &top = self->frames.back();
+    top.key = fostlib::string{k};
+    ++top.count;
+    for (auto &m : top.missing) {
+        if (const auto pos = m.second.find(top.key); pos != m.second.end()) {
+            m.second.erase(pos);
+        }
+    }
+    for (const auto n : top.nodes) {
+        if (const auto max = n->find(keyword::max_properties);
+            max && top.count > fostlib::coerce<int64_t>(max->part)) {
+            self->fail(max->name, max->spos, top.dpos);
+            return;
+        }
+        if (const auto names = n->find(keyword::property_names); names) {
+            self->checking = value{top.key};
+            if (not first_error(self->root, *names->subschema)) {
+                self->fail(names->name, names->spos, top.dpos);
+                return;
+            }
+        }
+    }
+}
+void f5::json::validation::stream::end_object() { self->end(); }
+void f5::json::validation::stream::start_array() {
+    self->start(container::array);
+}
+void f5::json::validation::stream::end_array() { self->end(); }
+void f5::json::validation::stream::scalar(value v) {
+    self->done(std::move(v));
+}
+
+
+bool f5::json::validation::stream::failed() const {
+    return self->error.has_value();
+}
+bool f5::json::validation::stream::complete() const {
+    return self->complete;
+}
+
+
+auto f5::json::validation::stream::outcome() const -> result {
+    if (self->error) {
+        const auto &e = *self->error;
+        return result{e.assertion, e.spos, e.dpos};
+    } else if (self->complete) {
+        return result{self->root};
+    } else {
+        throw fostlib::exceptions::not_implemented(
+                __PRETTY_FUNCTION__,
+                "The JSON value has not been completely seen yet");
+    }
+}
+
+
+/**
+ * ## `f5::json::validation::parse`
+ */
+
+
+namespace {
+
+
+    class parser {
+        std::streambuf &in;
+        f5::json::validation::stream &v;
+        std::size_t offset = 0;
+
+        int peek() { return in.sgetc(); }
+        int get() {
+            ++offset;
+            return in.sbumpc();
+        }
+        int skip_whitespace() {
+            while (is_whitespace(peek())) get();
+            return peek();
+        }
+
+        [[noreturn]] void error(f5::u8view message) {
+            fostlib::exceptions::parse_error e{fostlib::string{message}};
+            fostlib::insert(e.data(), "offset", int64_t(offset));
+            throw e;
+        }
+        void expect(f5::u8view literal) {
+            for (const auto c : literal) {
+                if (get() != int(c)) error("Invalid literal");
+            }
+        }
+
+        void append(std::string &s, char32_t cp) {
+            if (cp < 0x80) {
+                s += char(cp);
+            } else if (cp < 0x800) {
+                s += char(0xc0 | (cp >> 6));
+                s += char(0x80 | (cp & 0x3f));
+            } else if (cp < 0x10000) {
+                s += char(0xe0 | (cp >> 12));
+                s += char(0x80 | ((cp >> 6) & 0x3f));
+                s += char(0x80 | (cp & 0x3f));
+            } else {
+                s += char(0xf0 | (cp >> 18));
+                s += char(0x80 | ((cp >> 12) & 0x3f));
+                s += char(0x80 | ((cp >> 6) & 0x3f));
+                s += char(0x80 | (cp & 0x3f));
+            }
+        }
+        char32_t hex4() {
+            char32_t cp{};
+            for (int i{}; i < 4; ++i) {
+                const int c = get();
+                cp <<= 4;
+                if (c >= '0' && c <= '9') {
+                    cp |= c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    cp |= c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    cp |= c - 'A' + 10;
+                } else {
+                    error("Invalid \\u escape in string");
+                }
+            }
+            return cp;
+        }
+        std::string string() {
+            get(); // The opening "
+            std::string s;
+            while (true) {
+                const int c = get();
+                if (c == std::char_traits<char>::eof()) {
+                    error("Unterminated string");
+                } else if (c == '"') {
+                    return s;
+                } else if (c == '\\') {
+                    switch (const int e = get(); e) {
+                    case '"': s += '"'; break;
+                    case '\\': s += '\\'; break;
+                    case '/': s += '/'; break;
+                    case 'b': s += '\b'; break;
+                    case 'f': s += '\f'; break;
+                    case 'n': s += '\n'; break;
+                    case 'r': s += '\r'; break;
+                    case 't': s += '\t'; break;
+                    case 'u': {
+                        auto cp = hex4();
+                        if (cp >= 0xd800 && cp < 0xdc00) {
+                            expect("\\u");
+                            const auto low = hex4();
+                            if (low < 0xdc00 || low >= 0xe000) {
+                                error("Invalid surrogate pair in string");
+                            }
+                            cp = 0x10000 + ((cp - 0xd800) << 10)
+                                    + (low - 0xdc00);
+                        }
+                        append(s, cp);
+                        break;
+                    }
+                    default: error("Invalid escape in string");
+                    }
+                } else if (c < 0x20) {
+                    error("Control character in string");
+                } else {
+                    s += char(c);
+                }
+            }
+        }
+        /// Add one or more digits to the number
+        void digits(std::string &n) {
+            if (not is_digit(peek())) error("Invalid number");
+            while (is_digit(peek())) n += char(get());
+        }
+        f5::json::value number() {
+            std::string n;
+            if (peek() == '-') n += char(get());
+            if (peek() == '0') {
+                n += char(get());
+            } else {
+                digits(n);
+            }
+            if (peek() == '.') {
+                n += char(get());
+                digits(n);
+            }
+            if (peek() == 'e' || peek() == 'E') {
+                n += char(get());
+                if (peek() == '+' || peek() == '-') n += char(get());
+                digits(n);
+            }
+            if (n.find_first_of(".eE") == std::string::npos) {
+                errno = 0;
+                char *end{};
+                const auto i = std::strtoll(n.c_str(), &end, 10);
+                if (errno == 0 && end && *end == 0) {
+                    return f5::json::value{int64_t(i)};
+                }
+            }
+            return f5::json::value{std::strtod(n.c_str(), nullptr)};
+        }
+
+        /// Returns `false` once validation has failed so that parsing
+        /// can stop
+        bool parse_value() {
+            switch (skip_whitespace()) {
+            case '{':
+                get();
+                v.start_object();
+                if (skip_whitespace() == '}') {
+                    get();
+                } else {
+                    while (true) {
+                        if (skip_whitespace() != '"') {
+                            error("Expected a string for the object key");
+                        }
+                        v.key(string());
+                        if (skip_whitespace() != ':') error("Expected ':'");
+                        get();
+                        if (v.failed() || not parse_value()) return false;
+                        const int c = skip_whitespace();
+                        get();
+                        if (c == '}') break;
+                        if (c != ',') error("Expected ',' or '}'");
+                    }
+                }
+                v.end_object();
+                break;
+            case '[':
+                get();
+                v.start_array();
+                if (skip_whitespace() == ']') {
+                    get();
+                } else {
+                    while (true) {
+                        if (v.failed() || not parse_value()) return false;
+                        const int c = skip_whitespace();
+                        get();
+                        if (c == ']') break;
+                        if (c != ',') error("Expected ',' or ']'");
+                    }
+                }
+                v.end_array();
+                break;
+            case '"':
+                v.scalar(f5::json::value{fostlib::string{string()}});
+                break;
+            case 't':
+                expect("true");
+                v.scalar(f5::json::value{true});
+                break;
+            case 'f':
+                expect("false");
+                v.scalar(f5::json::value{false});
+                break;
+            case 'n':
+                expect("null");
+                v.scalar(f5::json::value{});
+                break;
+            default:
+                if (peek() == '-' || (peek() >= '0' && peek() <= '9')) {
+                    v.scalar(number());
+                } else {
+                    error("Unexpected character");
+                }
+            }
+            return not v.failed();
+        }
+
+      public:
+        parser(std::streambuf &i, f5::json::validation::stream &s)
+        : in{i}, v{s} {}
+
+        void operator()() {
+            if (parse_value()
+                && skip_whitespace() != std::char_traits<char>::eof()) {
+                error("Unexpected data after the JSON value");
+            }
+        }
+    };
+
+
+}
+
+
+void f5::json::validation::parse(std::istream &in, stream &v) {
+    if (not in.rdbuf()) {
+        throw fostlib::exceptions::not_implemented(
+                __func__, "The input stream has no buffer");
+    }
+    parser{*in.rdbuf(), v}();
+}
+
+
+/**
+ * ## `f5::json::schema`
+ */
+
+
+auto f5::json::schema::validate(std::istream &in) const -> validation::result {
+    validation::stream v{*this};
+    validation::parse(in, v);
+    /// The data is held by the stream validator, which is about to go
+    auto outcome = v.outcome();
+    outcome.detach();
+    return outcome;
+}
@@ -0,0 +1,395 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <fost/file>
+#include <fost/main>
+#include <fost/unicode>
+
+#include <chrono>
+#include <iomanip>
+#include <string_view>
+
+
+namespace {
+
+
+    const fostlib::setting<int64_t> c_iterations(
+            __FILE__,
+            "json-schema-bench",
+            "Iterations (zero means run for the minimum time)",
+            0,
+            true);
+    const fostlib::setting<int64_t> c_milliseconds(
+            __FILE__,
+            "json-schema-bench",
+            "Minimum milliseconds per benchmark",
+            250,
+            true);
+    const fostlib::setting<fostlib::string> c_filter(
+            __FILE__, "json-schema-bench", "Only run benchmarks containing", "",
+            true);
+    const fostlib::setting<bool> c_memo(
+            __FILE__,
+            "json-schema-bench",
+            "Remember sub-schema outcomes during each validation",
+            false,
+            true);
+    const fostlib::setting<bool> c_parallel(
+            __FILE__,
+            "json-schema-bench",
+            "Check large arrays and objects on several threads",
+            false,
+            true);
+
+
+    using clock = std::chrono::steady_clock;
+
+
+    auto load_json(const fostlib::string &fn) {
+        return f5::json::value::parse(fostlib::utf::load_file(
+                fostlib::coerce<boost::filesystem::path>(fn)));
+    }
+
+
+    /// Validate the data repeatedly and print the timings. When no
+    /// iteration count has been given the count is doubled until a run
+    /// takes at least the minimum time, so that the numbers are comparable
+    /// across machines and builds.
+    void run(fostlib::ostream &out,
+             f5::u8view name,
+             const f5::json::schema &s,
+             const f5::json::value &data) {
+        const f5::u8view filter{c_filter.value()};
+        if (std::string_view{name.data(), name.bytes()}.find(
+                    std::string_view{filter.data(), filter.bytes()})
+            == std::string_view::npos) {
+            return;
+        }
+        if (not s.validate(data)) {
+            throw fostlib::exceptions::not_implemented(
+                    __func__, "Benchmark data does not validate",
+                    f5::json::value{name});
+        }
+
+        const std::size_t bytes =
+                f5::u8view{fostlib::json::unparse(data, false)}.bytes();
+        const auto minimum = std::chrono::milliseconds(c_milliseconds.value());
+        std::size_t count =
+                c_iterations.value() > 0 ? c_iterations.value() : 1;
+        std::chrono::duration<double> taken{};
+        f5::json::validation::memo memo;
+        const f5::json::validation::parallel parallel;
+        const auto validate = [&]() {
+            if (c_memo.value()) {
+                return s.validate(data, memo);
+            } else if (c_parallel.value()) {
+                return s.validate(data, parallel);
+            } else {
+                return s.validate(data);
+            }
+        };
+        while (true) {
+            const auto started = clock::now();
+            for (std::size_t i{}; i < count; ++i) {
+                if (not validate()) {
+                    throw fostlib::exceptions::not_implemented(
+                            __func__, "Benchmark validation failed",
+                            f5::json::value{name});
+                }
+            }
+            taken = clock::now() - started;
+            if (c_iterations.value() > 0 || taken >= minimum) break;
+            count *= 2;
+        }
+
+        const double seconds = taken.count();
+        out << std::left << std::setw(36) << name << std::right
+                  << std::setw(10) << count << std::fixed
+                  << std::setprecision(0) << std::setw(14)
+                  << seconds * 1e9 / count << " ns" << std::setw(14)
+                  << count / seconds << " docs/s" << std::setprecision(2)
+                  << std::setw(10) << bytes * count / seconds / 1e6 << " MB/s"
+                  << std::endl;
+    }
+    void
+            run(fostlib::ostream &out,
+                f5::u8view name,
+                f5::u8view schema_json,
+                f5::u8view data_json) {
+        const f5::json::schema s{
+                fostlib::url{}, f5::json::value::parse(schema_json)};
+        run(out, name, s, f5::json::value::parse(data_json));
+    }
+
+
+    /// One small schema per keyword with an instance that passes it. This
+    /// measures the dispatch and the checker itself rather than the data.
+    void keywords(fostlib::ostream &out) {
+        run(out, "keyword/additionalItems",
+            R"({"items": [{}, {}], "additionalItems": {"type": "integer"}})",
+            R"([true, "a", 1, 2, 3, 4])");
+        run(out, "keyword/additionalProperties",
+            R"({"properties": {"a": {}}, "additionalProperties": false})",
+            R"({"a": 1})");
+        run(out, "keyword/additionalProperties-only",
+            R"({"additionalProperties": {"type": "integer"}})",
+            R"({"a": 1, "b": 2, "c": 3})");
+        run(out, "keyword/allOf",
+            R"({"allOf": [{"type": "integer"}, {"minimum": 0}]})", "10");
+        run(out, "keyword/anyOf",
+            R"({"anyOf": [{"type": "string"}, {"type": "integer"}]})", "10");
+        run(out, "keyword/const", R"({"const": {"a": [1, 2, 3]}})",
+            R"({"a": [1, 2, 3]})");
+        run(out, "keyword/contains", R"({"contains": {"const": 5}})",
+            "[1, 2, 3, 4, 5]");
+        run(out, "keyword/dependencies",
+            R"({"dependencies": {"a": ["b"], "c": {"required": ["d"]}}})",
+            R"({"a": 1, "b": 2, "c": 3, "d": 4})");
+        run(out, "keyword/enum",
+            R"({"enum": [1, "two", [3], {"four": 4}, null]})", "null");
+        run(out, "keyword/exclusiveMaximum", R"({"exclusiveMaximum": 10})",
+            "5");
+        run(out, "keyword/exclusiveMinimum", R"({"exclusiveMinimum": 0})",
+            "5");
+        run(out, "keyword/if-then-else",
+            R"({"if": {"type": "integer"}, "then": {"minimum": 0}, "else": {"type": "string"}})",
+            R"("text")");
+        run(out, "keyword/items", R"({"items": {"type": "integer"}})",
+            "[1, 2, 3, 4, 5, 6, 7, 8]");
+        run(out, "keyword/items-tuple",
+            R"({"items": [{"type": "integer"}, {"type": "string"}]})",
+            R"([1, "two"])");
+        run(out, "keyword/maximum", R"({"maximum": 10})", "5");
+        run(out, "keyword/maxItems", R"({"maxItems": 10})", "[1, 2, 3]");
+        run(out, "keyword/maxLength", R"({"maxLength": 20})",
+            R"("hello world")");
+        run(out, "keyword/maxProperties", R"({"maxProperties": 5})",
+            R"({"a": 1, "b": 2})");
+        run(out, "keyword/minimum", R"({"minimum": 0})", "5");
+        run(out, "keyword/minItems", R"({"minItems": 1})", "[1, 2, 3]");
+        run(out, "keyword/minLength", R"({"minLength": 2})",
+            R"("hello world")");
+        run(out, "keyword/minProperties", R"({"minProperties": 1})",
+            R"({"a": 1, "b": 2})");
+        run(out, "keyword/multipleOf", R"({"multipleOf": 0.5})", "12.5");
+        run(out, "keyword/not", R"({"not": {"type": "string"}})", "5");
+        run(out, "keyword/oneOf",
+            R"({"oneOf": [{"type": "string"}, {"type": "integer"}, {"type": "null"}]})",
+            "5");
+        run(out, "keyword/pattern", R"({"pattern": "^[a-z]+-[0-9]+$"})",
+            R"("abc-123")");
+        run(out, "keyword/patternProperties",
+            R"({"patternProperties": {"^x-": {"type": "string"}}})",
+            R"({"x-a": "1", "x-b": "2", "y": 3})");
+        run(out, "keyword/properties",
+            R"({"properties": {"a": {"type": "integer"}, "b": {"type": "string"}}})",
+            R"({"a": 1, "b": "two", "c": null})");
+        run(out, "keyword/propertyNames",
+            R"({"propertyNames": {"maxLength": 3}})",
+            R"({"a": 1, "bb": 2, "ccc": 3})");
+        run(out, "keyword/$ref",
+            R"({"definitions": {"n": {"type": "integer"}}, "$ref": "#/definitions/n"})",
+            "5");
+        run(out, "keyword/required", R"({"required": ["a", "b"]})",
+            R"({"a": 1, "b": 2, "c": 3})");
+        run(out, "keyword/type", R"({"type": ["string", "integer"]})", "5");
+        run(out, "keyword/uniqueItems", R"({"uniqueItems": true})",
+            R"([1, "1", [1], {"a": 1}, null, true])");
+    }
+
+
+    /// The schemas and instances used by the `check` target
+    void checks(fostlib::ostream &out, const fostlib::string &dir) {
+        const auto file = [&](const char *fn) {
+            return load_json(dir + "/" + fn);
+        };
+        const auto schema = [&](const char *fn) {
+            return f5::json::schema{fostlib::url{}, file(fn)};
+        };
+
+        const auto alltypes = file("alltypes.json");
+        const auto null = file("null.json");
+        run(out, "checks/any", schema("any.schema.json"), alltypes);
+        run(out, "checks/alltypes", schema("alltypes.schema.json"), alltypes);
+        run(out, "checks/null", schema("null.schema.json"), null);
+
+        const auto meta = schema("json-schema.schema.json");
+        run(out, "checks/meta-any", meta, file("any.schema.json"));
+        run(out, "checks/meta-alltypes", meta, file("alltypes.schema.json"));
+        run(out, "checks/meta-self", meta, file("json-schema.schema.json"));
+    }
+
+
+    /// Large generated documents. The sizes are fixed so that the results
+    /// from different runs can be compared.
+    void synthetic(fostlib::ostream &out) {
+        {
+            f5::json::value::object_t properties, data;
+            for (int64_t i{}; i < 2000; ++i) {
+                const fostlib::string name{"p" + std::to_string(i)};
+                f5::json::value::object_t property;
+                property["type"] = "integer";
+                property["minimum"] = i;
+                properties[name] = property;
+                data[name] = i;
+            }
+            f5::json::value::object_t s;
+            s["type"] = "object";
+            s["properties"] = properties;
+            s["additionalProperties"] = false;
+            run(out, "synthetic/wide-object",
+                f5::json::schema{fostlib::url{}, s}, data);
+        }
+        {
+            f5::json::value::array_t data;
+            for (int64_t i{}; i < 100000; ++i) data.push_back(i);
+            run(out, "synthetic/long-array",
+                f5::json::schema{
+                        fostlib::url{},
+                        f5::json::value::parse(
+                                R"({"type": "array", "items": {"type": "integer", "minimum": 0}})")},
+                data);
+        }
+        {
+            f5::json::value::array_t data;
+            for (int64_t i{}; i < 20000; ++i) {
+                f5::json::value::object_t item;
+                item["id"] = i;
+                item["name"] = fostlib::string{"item-" + std::to_string(i)};
+                data.push_back(item);
+            }
+            run(out, "synthetic/unique-items",
+                f5::json::schema{
+                        fostlib::url{},
+                        f5::json::value::parse(R"({"uniqueItems": true})")},
+                data);
+        }
+        {
+            f5::json::value::array_t codes, data;
+            for (std::size_t i{}; i < 5000; ++i) {
+                codes.push_back(fostlib::string{"code-" + std::to_string(i)});
+            }
+            for (std::size_t i{}; i < 1000; ++i) {
+                data.push_back(codes[(i * 7919) % codes.size()]);
+            }
+            f5::json::value::object_t items;
+            items["enum"] = codes;
+            f5::json::value::object_t s;
+            s["items"] = items;
+            run(out, "synthetic/large-enum",
+                f5::json::schema{fostlib::url{}, s}, data);
+        }
+        {
+            f5::json::value::array_t branches, data;
+            constexpr std::size_t kinds = 40;
+            for (std::size_t i{}; i < kinds; ++i) {
+                const fostlib::string kind{"event-" + std::to_string(i)};
+                f5::json::value::object_t k, payload, properties, b;
+                k["const"] = kind;
+                payload["type"] = "integer";
+                properties["type"] = k;
+                properties["payload"] = payload;
+                b["type"] = "object";
+                b["properties"] = properties;
+                b["required"] = f5::json::value::parse(R"(["type", "payload"])");
+                branches.push_back(b);
+            }
+            for (int64_t i{}; i < 1000; ++i) {
+                f5::json::value::object_t event;
+                event["type"] = fostlib::string{
+                        "event-" + std::to_string((i * 7) % kinds)};
+                event["payload"] = i;
+                data.push_back(event);
+            }
+            f5::json::value::object_t one_of;
+            one_of["oneOf"] = branches;
+            f5::json::value::object_t s;
+            s["items"] = one_of;
+            run(out, "synthetic/one-of-events",
+                f5::json::schema{fostlib::url{}, s}, data);
+        }
+        {
+            f5::json::value data{"leaf"};
+            for (std::size_t depth{}; depth < 200; ++depth) {
+                f5::json::value::object_t wrap;
+                wrap["child"] = data;
+                data = wrap;
+            }
+            run(out, "synthetic/deep-nesting",
+                f5::json::schema{
+                        fostlib::url{},
+                        f5::json::value::parse(
+                                R"({"anyOf": [{"type": "string"}, {"type": "object", "properties": {"child": {"$ref": "#"}}, "required": ["child"]}]})")},
+                data);
+        }
+        {
+            f5::json::value::object_t definitions;
+            constexpr std::size_t chain = 50;
+            for (std::size_t i{}; i < chain; ++i) {
+                f5::json::value::object_t d;
+                if (i + 1 < chain) {
+                    d["$ref"] = fostlib::string{
+                            "#/definitions/d" + std::to_string(i + 1)};
+                } else {
+                    d["type"] = "integer";
+                }
+                definitions[fostlib::string{"d" + std::to_string(i)}] = d;
+            }
+            f5::json::value::object_t items;
+            items["$ref"] = "#/definitions/d0";
+            f5::json::value::object_t s;
+            s["definitions"] = definitions;
+            s["items"] = items;
+            f5::json::value::array_t data;
+            for (int64_t i{}; i < 1000; ++i) data.push_back(i);
+            run(out, "synthetic/ref-chain", f5::json::schema{fostlib::url{}, s},
+                data);
+        }
+        {
+            /// Each level tries the definition of the next level twice, so
+            /// without a memo the work doubles with every level
+            f5::json::value data = f5::json::value::object_t{};
+            for (std::size_t depth{}; depth < 12; ++depth) {
+                f5::json::value::object_t wrap;
+                wrap["c"] = data;
+                data = wrap;
+            }
+            run(out, "synthetic/repeated-branches",
+                f5::json::schema{
+                        fostlib::url{},
+                        f5::json::value::parse(
+                                R"({"definitions": {"t": {"properties": {"c": {"$ref": "#/definitions/n"}}}, "n": {"anyOf": [{"allOf": [{"$ref": "#/definitions/t"}, {"required": ["x"]}]}, {"$ref": "#/definitions/t"}]}}, "$ref": "#/definitions/n"})")},
+                data);
+        }
+    }
+
+
+}
+
+
+FSL_MAIN("json-schema-bench", "JSON Schema Validator Benchmarks")
+(fostlib::ostream &out, fostlib::arguments &args) {
+    args.commandSwitch("n", c_iterations);
+    args.commandSwitch("t", c_milliseconds);
+    args.commandSwitch("f", c_filter);
+    args.commandSwitch("m", c_memo);
+    args.commandSwitch("p", c_parallel);
+
+    if (c_memo.value() && c_parallel.value()) {
+        /// A validation can't have both, so only one would be timed
+        out << "Use either -m or -p, not both" << std::endl;
+        return 1;
+    }
+
+    keywords(out);
+    for (const auto &arg : args) checks(out, arg);
+    synthetic(out);
+
+    return 0;
+}
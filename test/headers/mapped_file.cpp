@@ -0,0 +1 @@
+#include <f5/json/mapped_file.hpp>
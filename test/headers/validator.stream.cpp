@@ -0,0 +1 @@
+#include <f5/json/validator.stream.hpp>
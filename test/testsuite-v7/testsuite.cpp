@@ -13,6 +13,8 @@
 #include <fost/main>
 #include <fost/unicode>
 
+#include <sstream>
+
 
 namespace {
 
@@ -62,6 +64,9 @@ FSL_MAIN("json-schema-testsuite", "JSON Schema Test Suite Runner")
     int failed{};
     const fostlib::url base{c_base.value()};
     fostlib::http::user_agent ua;
+    /// Split even the smallest arrays and objects across threads
+    const f5::json::validation::parallel parallel{4, 2, 1};
+    f5::json::validation::memo memo;
 
     try {
         for (const auto &arg : args) {
@@ -78,11 +83,33 @@ FSL_MAIN("json-schema-testsuite", "JSON Schema Test Suite Runner")
                        << ':';
                     auto result = s.validate(example["data"]);
                     const bool valid{result};
-                    if (example["valid"] == fostlib::json(valid)) {
+                    /// The other ways of validating must agree with
+                    /// `validate`
+                    std::vector<f5::u8view> disagree;
+                    if (s.validate_all(example["data"], 8).empty() != valid) {
+                        disagree.push_back("validate_all");
+                    }
+                    std::stringstream json;
+                    json << fostlib::json::unparse(example["data"], false);
+                    if (bool(s.validate(static_cast<std::istream &>(json)))
+                        != valid) {
+                        disagree.push_back("stream");
+                    }
+                    if (bool(s.validate(example["data"], parallel)) != valid) {
+                        disagree.push_back("parallel");
+                    }
+                    if (bool(s.validate(example["data"], memo)) != valid) {
+                        disagree.push_back("memo");
+                    }
+                    if (example["valid"] == fostlib::json(valid)
+                        && disagree.empty()) {
                         ss << " Passed\n";
                     } else {
                         ++failed;
                         ss << " FAILED\n";
+                        for (const auto mode : disagree) {
+                            ss << "  " << mode << " disagrees\n";
+                        }
                         if (not result) {
                             auto e{(f5::json::validation::result::error)
                                            std::move(result)};
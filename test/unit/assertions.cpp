@@ -0,0 +1,250 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.compiled.hpp>
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+
+FSL_TEST_SUITE(assertions);
+
+
+namespace {
+    bool valid(const f5::json::schema &s, const char *json) {
+        return bool(s.validate(fostlib::json::parse(json)));
+    }
+}
+
+
+FSL_TEST_FUNCTION(dispatch_on_type) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"anyOf": [
+                    {"type": "string"},
+                    {"type": "integer", "minimum": 5},
+                    {"enum": [true, [1]]}]})")};
+    FSL_CHECK(valid(s, R"("a")"));
+    FSL_CHECK(valid(s, "6"));
+    FSL_CHECK(valid(s, "true"));
+    FSL_CHECK(valid(s, "[1]"));
+    FSL_CHECK(not valid(s, "3"));
+    FSL_CHECK(not valid(s, "false"));
+    FSL_CHECK(not valid(s, "null"));
+    FSL_CHECK(not valid(s, "{}"));
+}
+
+
+FSL_TEST_FUNCTION(dispatch_on_discriminator) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "definitions": {
+                    "cat": {
+                        "type": "object",
+                        "required": ["type", "lives"],
+                        "properties": {"type": {"const": "cat"}}},
+                    "dog": {
+                        "type": "object",
+                        "required": ["type", "bark"],
+                        "properties": {"type": {"const": "dog"}}},
+                    "bird": {
+                        "type": "object",
+                        "required": ["type"],
+                        "properties": {"type": {"enum": ["bird", "bat"]}}}},
+                "oneOf": [
+                    {"$ref": "#/definitions/cat"},
+                    {"$ref": "#/definitions/dog"},
+                    {"$ref": "#/definitions/bird"},
+                    {"type": "string"}]})")};
+    FSL_CHECK(valid(s, R"({"type": "cat", "lives": 9})"));
+    FSL_CHECK(valid(s, R"({"type": "dog", "bark": "woof"})"));
+    FSL_CHECK(valid(s, R"({"type": "bat"})"));
+    FSL_CHECK(valid(s, R"("cat")"));
+    /// The discriminator matches but the rest of the branch doesn't
+    FSL_CHECK(not valid(s, R"({"type": "cat", "bark": "woof"})"));
+    FSL_CHECK(not valid(s, R"({"type": "fish"})"));
+    FSL_CHECK(not valid(s, R"({"type": 1})"));
+    FSL_CHECK(not valid(s, R"({"lives": 9})"));
+    FSL_CHECK(not valid(s, "1"));
+}
+
+
+FSL_TEST_FUNCTION(dispatch_without_discriminator) {
+    /// The second branch doesn't require the property, so it has to be
+    /// tried for objects without it as well as for those with its value
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"oneOf": [
+                    {"required": ["kind"],
+                        "properties": {"kind": {"const": "a"}}},
+                    {"properties": {"kind": {"const": "b"}}}]})")};
+    FSL_CHECK(valid(s, R"({"kind": "a"})"));
+    FSL_CHECK(valid(s, R"({"kind": "b"})"));
+    FSL_CHECK(valid(s, "{}"));
+    FSL_CHECK(not valid(s, R"({"kind": "c"})"));
+    /// Both branches accept values that aren't objects
+    FSL_CHECK(not valid(s, "1"));
+}
+
+
+FSL_TEST_FUNCTION(one_of_two_matches) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"oneOf": [
+                    {"properties": {"kind": {"const": "a"}}},
+                    {"properties": {"kind": {"enum": ["a", "b"]}}},
+                    {"properties": {"kind": {"const": "c"}}}]})")};
+    FSL_CHECK(not valid(s, R"({"kind": "a"})"));
+    FSL_CHECK(valid(s, R"({"kind": "b"})"));
+    FSL_CHECK(valid(s, R"({"kind": "c"})"));
+}
+
+
+FSL_TEST_FUNCTION(object_dependencies) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "properties": {"a": {"type": "integer"}},
+                "required": ["a"],
+                "dependencies": {
+                    "b": ["c", "d"],
+                    "e": {"required": ["f"]}}})")};
+    FSL_CHECK(valid(s, R"({"a": 1})"));
+    FSL_CHECK(valid(s, R"({"a": 1, "c": 1})"));
+    FSL_CHECK(valid(s, R"({"a": 1, "b": 1, "c": 1, "d": 1})"));
+    FSL_CHECK(valid(s, R"({"a": 1, "e": 1, "f": 1})"));
+    FSL_CHECK(not valid(s, R"({"a": 1, "b": 1, "c": 1})"));
+    FSL_CHECK(not valid(s, R"({"a": 1, "e": 1})"));
+    FSL_CHECK(not valid(s, R"({"b": 1, "c": 1, "d": 1})"));
+    auto e = f5::json::validation::result::error(
+            s.validate(fostlib::json::parse(R"({"a": 1, "b": 1, "d": 1})")));
+    FSL_CHECK_EQ(e.assertion, "dependencies");
+    /// The schema position ends with the name that is missing
+    FSL_CHECK_EQ(e.spos, (fostlib::jcursor{"dependencies", "c"}));
+}
+
+
+FSL_TEST_FUNCTION(object_many_names) {
+    /// More names than fit in the fixed set of seen names
+    f5::json::value::array_t names;
+    f5::json::value::object_t all;
+    for (std::size_t n{}; n < 100; ++n) {
+        const auto name = "n" + std::to_string(n);
+        names.push_back(fostlib::json{name.c_str()});
+        all[fostlib::string{name.c_str()}] = int64_t(n);
+    }
+    f5::json::value::object_t schema;
+    schema["required"] = names;
+    schema["dependencies"] = fostlib::json::parse(R"({"n0": ["n99"]})");
+    const f5::json::schema s{fostlib::url{}, schema};
+
+    FSL_CHECK(bool(s.validate(f5::json::value{all})));
+    auto missing = all;
+    missing.erase("n99");
+    auto e = f5::json::validation::result::error(
+            s.validate(f5::json::value{missing}));
+    FSL_CHECK_EQ(e.assertion, "dependencies");
+    missing.erase("n0");
+    e = f5::json::validation::result::error(
+            s.validate(f5::json::value{missing}));
+    FSL_CHECK_EQ(e.assertion, "required");
+}
+
+
+FSL_TEST_FUNCTION(hash_follows_equality) {
+    using f5::json::compiled::hash;
+    const auto j = [](const char *json) { return fostlib::json::parse(json); };
+    FSL_CHECK_EQ(hash(j("1")), hash(j("1.0")));
+    FSL_CHECK_EQ(hash(j("0")), hash(j("-0.0")));
+    FSL_CHECK(hash(j("1")) != hash(j(R"("1")")));
+    FSL_CHECK(hash(j("[1, 2]")) != hash(j("[2, 1]")));
+    FSL_CHECK_EQ(
+            hash(j(R"({"a": 1, "b": [true, null]})")),
+            hash(j(R"({"b": [true, null], "a": 1})")));
+    /// Integers too large for a `double` to tell apart hash the same
+    FSL_CHECK_EQ(
+            hash(j("9007199254740992")), hash(j("9007199254740993")));
+}
+
+
+FSL_TEST_FUNCTION(unique_items) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"uniqueItems": true})")};
+    FSL_CHECK(valid(s, "[]"));
+    FSL_CHECK(valid(s, "[1]"));
+    FSL_CHECK(valid(s, R"([1, "1", [1], {"1": 1}, true, null])"));
+    FSL_CHECK(not valid(s, "[1, 1.0]"));
+    FSL_CHECK(not valid(s, "[0, -0.0]"));
+    FSL_CHECK(not valid(s, R"(["1", "1"])"));
+    FSL_CHECK(valid(s, "[[1, 2], [2, 1]]"));
+    FSL_CHECK(not valid(s, "[[1, [2]], [1, [2.0]]]"));
+    FSL_CHECK(not valid(s, R"([{"a": 1, "b": {"c": []}},
+            {"b": {"c": []}, "a": 1}])"));
+    FSL_CHECK(valid(s, R"([{"a": 1}, {"a": 1, "b": 1}])"));
+    /// Items whose hashes are the same but that aren't equal
+    FSL_CHECK(valid(s, "[9007199254740992, 9007199254740993]"));
+    FSL_CHECK(not valid(
+            s, "[9007199254740992, 9007199254740993, 9007199254740992]"));
+}
+
+
+FSL_TEST_FUNCTION(unique_items_large) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"uniqueItems": true})")};
+    f5::json::value::array_t items;
+    for (int64_t i{}; i < 10000; ++i) {
+        items.push_back(f5::json::value{i});
+        items.push_back(f5::json::value{fostlib::string{std::to_string(i)}});
+    }
+    FSL_CHECK(bool(s.validate(f5::json::value{items})));
+    items.push_back(f5::json::value{double(5000)});
+    FSL_CHECK(not s.validate(f5::json::value{items}));
+}
+
+
+FSL_TEST_FUNCTION(enum_and_const) {
+    const f5::json::schema e{
+            fostlib::url{},
+            fostlib::json::parse(R"({"enum": [
+                    1, "2", [3, [4]], {"a": {"b": null}},
+                    9007199254740992]})")};
+    FSL_CHECK(valid(e, "1"));
+    FSL_CHECK(valid(e, "1.0"));
+    FSL_CHECK(not valid(e, R"("1")"));
+    FSL_CHECK(not valid(e, "2"));
+    FSL_CHECK(valid(e, R"("2")"));
+    FSL_CHECK(valid(e, "[3, [4.0]]"));
+    FSL_CHECK(not valid(e, "[[4], 3]"));
+    FSL_CHECK(not valid(e, "[3, 4]"));
+    FSL_CHECK(valid(e, R"({"a": {"b": null}})"));
+    FSL_CHECK(not valid(e, R"({"a": {"b": false}})"));
+    FSL_CHECK(not valid(e, R"({"a": {"b": null}, "c": 1})"));
+    FSL_CHECK(valid(e, "9007199254740992"));
+    FSL_CHECK(not valid(e, "9007199254740993"));
+
+    const f5::json::schema c{
+            fostlib::url{},
+            fostlib::json::parse(R"({"const": {"x": [1, 2], "y": "z"}})")};
+    FSL_CHECK(valid(c, R"({"y": "z", "x": [1.0, 2]})"));
+    FSL_CHECK(not valid(c, R"({"y": "z", "x": [2, 1]})"));
+    FSL_CHECK(not valid(c, R"({"x": [1, 2]})"));
+
+    f5::json::value::array_t values;
+    for (int64_t i{}; i < 10000; ++i) values.push_back(f5::json::value{i});
+    f5::json::value::object_t big;
+    big["enum"] = values;
+    const f5::json::schema b{fostlib::url{}, big};
+    FSL_CHECK(valid(b, "0"));
+    FSL_CHECK(valid(b, "9999"));
+    FSL_CHECK(valid(b, "5000.0"));
+    FSL_CHECK(not valid(b, "10000"));
+    FSL_CHECK(not valid(b, "0.5"));
+    FSL_CHECK(not valid(b, R"("5000")"));
+}
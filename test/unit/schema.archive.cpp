@@ -0,0 +1,160 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.cache.hpp>
+
+#include <fost/test>
+
+#include <fstream>
+#include <iterator>
+
+
+FSL_TEST_SUITE(schema_archive);
+
+
+namespace {
+    const auto rich = fostlib::json::parse(R"({
+            "$comment": "Grüße",
+            "examples": [null, true, false, 0, -12, 1.5, "", [[]], {"a": {}}],
+            "properties": {"a": {"type": "integer", "maximum": 3}}})");
+
+    boost::filesystem::path temporary(f5::u8view name) {
+        return boost::filesystem::temp_directory_path()
+                / ("f5-json-schema-" + static_cast<std::string>(name));
+    }
+
+    std::string read(const boost::filesystem::path &fn) {
+        std::ifstream in{fn.string(), std::ios::binary};
+        return std::string{std::istreambuf_iterator<char>{in}, {}};
+    }
+    void write(const boost::filesystem::path &fn, const std::string &bytes) {
+        std::ofstream out{fn.string(), std::ios::binary | std::ios::trunc};
+        out.write(bytes.data(), bytes.size());
+    }
+
+    /// Build archive bytes by hand, following the format described in
+    /// `schema.archive.cpp`
+    struct archive {
+        std::string bytes{"f5jsarc", 8};
+        template<typename N>
+        archive &number(N n) {
+            bytes.append(reinterpret_cast<const char *>(&n), sizeof(n));
+            return *this;
+        }
+        archive &string(const std::string &s) {
+            number(std::uint64_t(s.size()));
+            bytes += s;
+            return *this;
+        }
+        archive &tag(char t) {
+            bytes += t;
+            return *this;
+        }
+        /// The header for the number of schemas
+        explicit archive(std::uint32_t schemas) {
+            number(std::uint32_t(1)).number(std::uint32_t(0x01020304));
+            number(schemas);
+        }
+        /// The start of a schema with one name
+        archive &schema(const std::string &url) {
+            return string(url).number(std::uint32_t(1)).string(url);
+        }
+    };
+    constexpr char null_tag = 0, array_tag = 6;
+
+    bool loads(const std::string &bytes) {
+        const auto fn = temporary("archive-test.bin");
+        write(fn, bytes);
+        try {
+            f5::json::load_schema_archive(fn);
+            boost::filesystem::remove(fn);
+            return true;
+        } catch (fostlib::exceptions::exception &) {
+            boost::filesystem::remove(fn);
+            return false;
+        }
+    }
+
+    const f5::json::schema *loaded(f5::u8view name) {
+        for (const auto &l : f5::json::schema_cache::loaded()) {
+            if (l.first == name) return l.second;
+        }
+        return nullptr;
+    }
+}
+
+
+FSL_TEST_FUNCTION(round_trip) {
+    f5::json::schema_cache::add_loaded(
+            "http://example.com/archive/rich",
+            f5::json::schema{fostlib::url{}, rich});
+    const auto fn = temporary("archive-round-trip.bin");
+    const auto saved = f5::json::save_schema_archive(fn);
+    FSL_CHECK(saved > 0u);
+
+    /// The schema is already loaded under its name, so rename it in the
+    /// file to make sure that what is checked is read from the archive
+    auto bytes = read(fn);
+    const auto at = bytes.find("archive/rich");
+    FSL_CHECK(at != std::string::npos);
+    bytes.replace(at, 12, "archive/copy");
+    write(fn, bytes);
+
+    FSL_CHECK_EQ(f5::json::load_schema_archive(fn), saved);
+    const auto copy = loaded("http://example.com/archive/copy");
+    FSL_CHECK(copy != nullptr);
+    FSL_CHECK_EQ(copy->assertions(), rich);
+    FSL_CHECK(bool(copy->validate(fostlib::json::parse(R"({"a": 3})"))));
+    FSL_CHECK(not copy->validate(fostlib::json::parse(R"({"a": 4})")));
+    boost::filesystem::remove(fn);
+}
+
+
+FSL_TEST_FUNCTION(truncated) {
+    auto good = archive{1}.schema("http://example.com/archive/truncated");
+    good.tag(array_tag).number(std::uint64_t(2)).tag(null_tag).tag(null_tag);
+    FSL_CHECK(loads(good.bytes));
+    for (std::size_t size{}; size < good.bytes.size(); ++size) {
+        FSL_CHECK(not loads(good.bytes.substr(0, size)));
+    }
+}
+
+
+FSL_TEST_FUNCTION(counts_past_the_end) {
+    FSL_CHECK(not loads(archive{0xffffffff}.bytes));
+    /// The name count, a string length and an array length
+    FSL_CHECK(not loads(archive{1}
+                                .string("http://example.com/archive/c1")
+                                .number(std::uint32_t(0xffffffff))
+                                .bytes));
+    FSL_CHECK(not loads(archive{1}
+                                .string("http://example.com/archive/c2")
+                                .number(std::uint32_t(1))
+                                .number(std::uint64_t(1) << 62)
+                                .bytes));
+    FSL_CHECK(not loads(archive{1}
+                                .schema("http://example.com/archive/c3")
+                                .tag(array_tag)
+                                .number(std::uint64_t(1) << 62)
+                                .tag(null_tag)
+                                .bytes));
+}
+
+
+FSL_TEST_FUNCTION(too_deep) {
+    const auto nested = [](const char *url, std::size_t depth) {
+        archive a{1};
+        a.schema(url);
+        for (std::size_t d{}; d < depth; ++d) {
+            a.tag(array_tag).number(std::uint64_t(1));
+        }
+        return a.tag(null_tag).bytes;
+    };
+    FSL_CHECK(loads(nested("http://example.com/archive/deep", 256)));
+    FSL_CHECK(not loads(nested("http://example.com/archive/deeper", 257)));
+    FSL_CHECK(not loads(nested("http://example.com/archive/deepest", 100000)));
+}
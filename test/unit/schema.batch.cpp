@@ -0,0 +1,75 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+
+FSL_TEST_SUITE(schema_batch);
+
+
+namespace {
+    const f5::json::schema even{
+            fostlib::url{},
+            fostlib::json::parse(R"({"type": "integer", "multipleOf": 2})")};
+
+    std::vector<f5::json::value> numbers(std::size_t count) {
+        std::vector<f5::json::value> batch;
+        for (std::size_t n{}; n < count; ++n) {
+            batch.push_back(fostlib::json(int64_t(n)));
+        }
+        return batch;
+    }
+}
+
+
+FSL_TEST_FUNCTION(batch_empty) {
+    FSL_CHECK(even.validate_batch(std::vector<f5::json::value>{}).empty());
+}
+
+
+FSL_TEST_FUNCTION(batch_results_in_order) {
+    const auto batch = numbers(200);
+    for (std::size_t threads : {1, 2, 8}) {
+        f5::json::batch_options options;
+        options.threads = threads;
+        const auto results = even.validate_batch(batch, options);
+        FSL_CHECK_EQ(results.size(), batch.size());
+        for (std::size_t n{}; n < batch.size(); ++n) {
+            FSL_CHECK(results[n].has_value());
+            FSL_CHECK_EQ(bool(*results[n]), n % 2 == 0);
+        }
+    }
+}
+
+
+FSL_TEST_FUNCTION(batch_iterators) {
+    const auto batch = numbers(10);
+    const auto results = even.validate_batch(batch.begin(), batch.end());
+    FSL_CHECK_EQ(results.size(), 10u);
+    FSL_CHECK(bool(*results[4]));
+    FSL_CHECK(not bool(*results[5]));
+}
+
+
+FSL_TEST_FUNCTION(batch_stop_on_failure) {
+    std::vector<f5::json::value> batch(500, fostlib::json(int64_t(2)));
+    batch[100] = fostlib::json(int64_t(3));
+    f5::json::batch_options options;
+    options.threads = 4;
+    options.stop_on_failure = true;
+    const auto results = even.validate_batch(batch, options);
+    FSL_CHECK_EQ(results.size(), batch.size());
+    /// Every document before the failing one has passed
+    for (std::size_t n{}; n < 100; ++n) {
+        FSL_CHECK(results[n].has_value());
+        FSL_CHECK(bool(*results[n]));
+    }
+    FSL_CHECK(results[100].has_value());
+    FSL_CHECK(not bool(*results[100]));
+}
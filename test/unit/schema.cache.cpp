@@ -0,0 +1,192 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.loaders.hpp>
+
+#include <fost/test>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+FSL_TEST_SUITE(schema_cache);
+
+
+namespace {
+    /// Load a directory, a glob and a file whose name looks like a glob
+    const fostlib::setting<f5::json::value> c_schema_path{
+            __FILE__, f5::json::c_schema_path, []() {
+                f5::json::value::array_t path;
+                path.push_back(SCHEMA_DIRECTORY "/schemas/directory");
+                path.push_back(SCHEMA_DIRECTORY "/schemas/glob/*.schema.json");
+                path.push_back(
+                        SCHEMA_DIRECTORY
+                        "/schemas/literal/literal[1].schema.json");
+                return path;
+            }()};
+
+    bool loaded(f5::u8view id) {
+        const auto root = f5::json::schema_cache::root_cache();
+        for (const auto &entry : root->entries()) {
+            if (entry.first == id) return true;
+        }
+        return false;
+    }
+
+    /// A loader that holds on to each load until all of the threads
+    /// that want it have asked for it, and fails the ones called `bad`
+    constexpr std::size_t waiters = 4;
+    std::mutex flight_mutex;
+    std::condition_variable flight_started;
+    std::size_t started = 0;
+    std::map<fostlib::string, std::size_t> flights;
+
+    struct load_failure : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    const f5::json::schema_loader c_flight{
+            "unit-test-flight",
+            [](f5::u8view url,
+               f5::json::value) -> std::unique_ptr<f5::json::schema> {
+                if (not url.starts_with("http://example.com/flight/")) {
+                    return {};
+                }
+                const fostlib::string name{url};
+                {
+                    std::unique_lock<std::mutex> lock{flight_mutex};
+                    ++flights[name];
+                    flight_started.wait_for(
+                            lock, std::chrono::seconds{5},
+                            []() { return started == waiters; });
+                }
+                /// Give the other threads time to start waiting
+                std::this_thread::sleep_for(std::chrono::milliseconds{200});
+                if (name == "http://example.com/flight/bad") {
+                    throw load_failure{"Unit test load failure"};
+                }
+                return std::make_unique<f5::json::schema>(
+                        fostlib::url{url},
+                        fostlib::json::parse(R"({"type": "string"})"));
+            }};
+
+    /// Look up the URL from several threads at once
+    template<typename F>
+    void in_flight(f5::u8view url, F f) {
+        {
+            std::unique_lock<std::mutex> lock{flight_mutex};
+            started = 0;
+        }
+        std::vector<std::thread> threads;
+        for (std::size_t t{}; t != waiters; ++t) {
+            threads.emplace_back([url, f, t]() {
+                {
+                    std::unique_lock<std::mutex> lock{flight_mutex};
+                    ++started;
+                }
+                flight_started.notify_all();
+                f(t, url);
+            });
+        }
+        for (auto &t : threads) t.join();
+    }
+}
+
+
+FSL_TEST_FUNCTION(load_path_entries) {
+    FSL_CHECK(loaded("http://example.com/unit/directory/a"));
+    FSL_CHECK(loaded("http://example.com/unit/directory/b"));
+    FSL_CHECK(loaded("http://example.com/unit/glob/one"));
+    FSL_CHECK(loaded("http://example.com/unit/glob/two"));
+    FSL_CHECK(not loaded("http://example.com/unit/glob/other"));
+    FSL_CHECK(loaded("http://example.com/unit/literal/brackets"));
+    FSL_CHECK(not loaded("http://example.com/unit/literal/one"));
+}
+
+
+FSL_TEST_FUNCTION(load_path_references) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"items": [
+                    {"$ref": "http://example.com/unit/directory/a"},
+                    {"$ref": "http://example.com/unit/directory/b"}]})")};
+    FSL_CHECK(bool(s.validate(fostlib::json::parse(R"(["a", 1])"))));
+    FSL_CHECK(not s.validate(fostlib::json::parse(R"([1, "a"])")));
+}
+
+
+FSL_TEST_FUNCTION(load_path_references_in_scope) {
+    const f5::json::schema cached{
+            fostlib::url{},
+            fostlib::json::parse(R"({"$ref":
+                    "http://example.com/unit/directory/refers"})")};
+    /// The same references, but with a `$id` that takes the place of one
+    /// of the schemas in the cache
+    const f5::json::schema scoped{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "$id": "http://example.com/unit/scoped",
+                "definitions": {"two": {
+                    "$id": "http://example.com/unit/glob/two",
+                    "type": "string"}},
+                "allOf": [
+                    {"$ref": "http://example.com/unit/directory/refers"}]})")};
+    for (std::size_t times{}; times != 2; ++times) {
+        FSL_CHECK(bool(cached.validate(fostlib::json::parse(R"([1])"))));
+        FSL_CHECK(not cached.validate(fostlib::json::parse(R"(["a"])")));
+        FSL_CHECK(bool(cached.validate(fostlib::json::parse(R"({"n": 1})"))));
+        FSL_CHECK(not cached.validate(fostlib::json::parse(R"({"n": "a"})")));
+
+        FSL_CHECK(bool(scoped.validate(fostlib::json::parse(R"(["a"])"))));
+        FSL_CHECK(not scoped.validate(fostlib::json::parse(R"([1])")));
+        FSL_CHECK(bool(scoped.validate(fostlib::json::parse(R"({"n": "a"})"))));
+        FSL_CHECK(not scoped.validate(fostlib::json::parse(R"({"n": 1})")));
+    }
+}
+
+
+FSL_TEST_FUNCTION(single_flight) {
+    const auto root = f5::json::schema_cache::root_cache();
+    std::array<const f5::json::schema *, waiters> found{};
+    in_flight(
+            "http://example.com/flight/good",
+            [&](std::size_t t, f5::u8view url) { found[t] = &(*root)[url]; });
+    FSL_CHECK_EQ(flights["http://example.com/flight/good"], 1u);
+    for (const auto s : found) FSL_CHECK(s == found[0]);
+    FSL_CHECK(bool(found[0]->validate(f5::json::value{"string"})));
+}
+
+
+FSL_TEST_FUNCTION(single_flight_failure) {
+    const auto root = f5::json::schema_cache::root_cache();
+    std::array<std::string, waiters> errors{};
+    in_flight(
+            "http://example.com/flight/bad",
+            [&](std::size_t t, f5::u8view url) {
+                try {
+                    (*root)[url];
+                } catch (load_failure &e) {
+                    errors[t] = e.what();
+                } catch (std::exception &e) {
+                    errors[t] = std::string{"Wrong exception: "} + e.what();
+                }
+            });
+    /// Every thread gets the loader's own exception, not a missing schema
+    FSL_CHECK_EQ(flights["http://example.com/flight/bad"], 1u);
+    for (const auto &e : errors) FSL_CHECK_EQ(e, "Unit test load failure");
+
+    /// The failure isn't remembered, so a later look up tries again
+    FSL_CHECK_EXCEPTION(
+            (*root)["http://example.com/flight/bad"], load_failure &);
+    FSL_CHECK_EQ(flights["http://example.com/flight/bad"], 2u);
+}
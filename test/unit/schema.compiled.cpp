@@ -0,0 +1,77 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.compiled.hpp>
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+
+FSL_TEST_SUITE(schema_compiled);
+
+
+namespace {
+    std::vector<fostlib::string> order(const f5::json::schema &s) {
+        std::vector<fostlib::string> names;
+        for (const auto r : s.root().checks) {
+            names.push_back(fostlib::string{r->name});
+        }
+        return names;
+    }
+    f5::json::validation::result::error
+            first(const f5::json::schema &s, const char *json) {
+        return f5::json::validation::result::error(
+                s.validate(fostlib::json{json}));
+    }
+}
+
+
+FSL_TEST_FUNCTION(reorder) {
+    f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "definitions": {
+                    "short": {"maxLength": 5},
+                    "named": {
+                        "$id": "http://example.com/reorder/named",
+                        "minLength": 2}},
+                "allOf": [
+                    {"$ref": "#/definitions/short"},
+                    {"$ref": "http://example.com/reorder/named"}],
+                "maxLength": 3,
+                "pattern": "^a"})")};
+    const auto cheapest_first = order(s);
+    const std::vector<fostlib::string> expected{"maxLength", "pattern"};
+    FSL_CHECK(
+            std::search(
+                    cheapest_first.begin(), cheapest_first.end(),
+                    expected.begin(), expected.end())
+            != cheapest_first.end());
+    FSL_CHECK_EQ(first(s, "bbbb").assertion, "maxLength");
+
+    /// The pattern rejects all of this traffic, and `maxLength` none of it
+    f5::json::validation::profile p;
+    for (std::size_t n{}; n < 1000; ++n) s.validate(fostlib::json{"b"}, p);
+    const f5::json::schema before{s};
+    s.reorder(p);
+
+    const auto reordered = order(s);
+    FSL_CHECK(
+            std::find(reordered.begin(), reordered.end(), "pattern")
+            < std::find(reordered.begin(), reordered.end(), "maxLength"));
+    FSL_CHECK_EQ(first(s, "bbbb").assertion, "pattern");
+    /// Whether the data is valid doesn't change
+    FSL_CHECK(bool(s.validate(fostlib::json{"abc"})));
+    FSL_CHECK(not s.validate(fostlib::json{"abcd"}));
+    FSL_CHECK(not s.validate(fostlib::json{"b"}));
+    FSL_CHECK(not s.validate(fostlib::json{"a"}));
+
+    /// The copy taken beforehand still has its own graph
+    FSL_CHECK(order(before) == cheapest_first);
+    FSL_CHECK_EQ(first(before, "bbbb").assertion, "maxLength");
+    FSL_CHECK(&before.root() != &s.root());
+}
@@ -0,0 +1,55 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+
+FSL_TEST_SUITE(schema);
+
+
+namespace {
+    const f5::json::schema two_properties{
+            fostlib::url{},
+            fostlib::json::parse(R"({"properties": {
+                    "a": {"type": "string"},
+                    "b": {"minimum": 3}}})")};
+    const auto both_wrong = fostlib::json::parse(R"({"a": 1, "b": 1})");
+}
+
+
+FSL_TEST_FUNCTION(validate_all_valid) {
+    const auto data = fostlib::json::parse(R"({"a": "a", "b": 3})");
+    FSL_CHECK(two_properties.validate_all(data, 10).empty());
+}
+
+
+FSL_TEST_FUNCTION(validate_all_finds_every_error) {
+    const auto errors = two_properties.validate_all(both_wrong, 10);
+    FSL_CHECK_EQ(errors.size(), 2u);
+    FSL_CHECK_EQ(errors[0].assertion, "type");
+    FSL_CHECK_EQ(errors[0].dpos, fostlib::jcursor{"a"});
+    FSL_CHECK_EQ(errors[1].assertion, "minimum");
+    FSL_CHECK_EQ(errors[1].dpos, fostlib::jcursor{"b"});
+}
+
+
+FSL_TEST_FUNCTION(validate_all_limit) {
+    FSL_CHECK_EQ(two_properties.validate_all(both_wrong, 1).size(), 1u);
+    /// A limit of zero is the same as one
+    FSL_CHECK_EQ(two_properties.validate_all(both_wrong, 0).size(), 1u);
+}
+
+
+FSL_TEST_FUNCTION(validate_all_first_is_validate) {
+    const auto errors = two_properties.validate_all(both_wrong, 10);
+    auto e = f5::json::validation::result::error(
+            two_properties.validate(both_wrong));
+    FSL_CHECK_EQ(errors[0].assertion, e.assertion);
+    FSL_CHECK_EQ(errors[0].dpos, e.dpos);
+}
@@ -0,0 +1,25 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.loaders.hpp>
+
+
+namespace {
+    /// The schema loaders used by the tests. Each only answers for its
+    /// own URLs, so they can all be listed together
+    const fostlib::setting<f5::json::value> c_schema_loaders{
+            __FILE__, f5::json::c_schema_loaders, []() {
+                f5::json::value::array_t loaders;
+                for (const auto name :
+                     {"unit-test-prefetch", "unit-test-flight"}) {
+                    f5::json::value::object_t loader;
+                    loader["loader"] = name;
+                    loaders.push_back(loader);
+                }
+                return loaders;
+            }()};
+}
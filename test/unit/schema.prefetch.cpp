@@ -0,0 +1,85 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.cache.hpp>
+#include <f5/json/schema.loaders.hpp>
+
+#include <fost/test>
+
+#include <algorithm>
+#include <mutex>
+
+
+FSL_TEST_SUITE(schema_prefetch);
+
+
+namespace {
+    /// The remote schemas, and how many times each has been loaded
+    const auto remotes = fostlib::json::parse(R"({
+            "http://example.com/prefetch/b": {
+                "definitions": {"x": {"$ref": "c"}}},
+            "http://example.com/prefetch/c": {
+                "items": {"$ref": "b#/definitions/x"},
+                "type": "array"},
+            "http://example.com/prefetch/d": {"type": "string"}})");
+    std::mutex mutex;
+    std::map<fostlib::string, std::size_t> loads;
+
+    const f5::json::schema_loader c_loader{
+            "unit-test-prefetch",
+            [](f5::u8view url,
+               f5::json::value) -> std::unique_ptr<f5::json::schema> {
+                const fostlib::string name{url};
+                if (not remotes.has_key(name)) return {};
+                {
+                    std::unique_lock<std::mutex> lock{mutex};
+                    ++loads[name];
+                }
+                return std::make_unique<f5::json::schema>(
+                        fostlib::url{url}, remotes[name]);
+            }};
+
+    bool contains(const std::vector<fostlib::string> &v, f5::u8view s) {
+        return std::find(v.begin(), v.end(), fostlib::string{s}) != v.end();
+    }
+}
+
+
+FSL_TEST_FUNCTION(prefetch) {
+    const f5::json::schema s{
+            fostlib::url{"http://example.com/prefetch/a"},
+            fostlib::json::parse(R"({"properties": {
+                    "b": {"$ref": "b#/definitions/x"},
+                    "d": {"$ref": "d"},
+                    "e": {"$ref": "e"},
+                    "f": {"$ref": "d#/nothing"}}})")};
+    const auto found = f5::json::prefetch(s, 4);
+
+    /// Each schema that can be reached is loaded exactly once, even
+    /// though `b` and `c` refer to each other
+    FSL_CHECK_EQ(found.schemas.size(), 3u);
+    FSL_CHECK(contains(found.schemas, "http://example.com/prefetch/b"));
+    FSL_CHECK(contains(found.schemas, "http://example.com/prefetch/c"));
+    FSL_CHECK(contains(found.schemas, "http://example.com/prefetch/d"));
+    FSL_CHECK_EQ(loads.size(), 3u);
+    for (const auto &l : loads) FSL_CHECK_EQ(l.second, 1u);
+
+    /// Neither a missing schema nor a position that isn't in a schema
+    /// can be resolved
+    FSL_CHECK_EQ(found.unresolved.size(), 2u);
+    std::vector<fostlib::string> unresolved;
+    for (const auto &u : found.unresolved) unresolved.push_back(u.first);
+    FSL_CHECK(contains(unresolved, "e"));
+    FSL_CHECK(contains(unresolved, "d#/nothing"));
+
+    /// Validation doesn't need to load anything else
+    FSL_CHECK(bool(s.validate(fostlib::json::parse(
+            R"({"b": [[]], "d": "d"})"))));
+    FSL_CHECK(not s.validate(fostlib::json::parse(R"({"b": [1]})")));
+    FSL_CHECK_EQ(loads.size(), 3u);
+    for (const auto &l : loads) FSL_CHECK_EQ(l.second, 1u);
+}
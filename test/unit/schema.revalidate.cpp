@@ -0,0 +1,202 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+#include <random>
+
+
+FSL_TEST_SUITE(schema_revalidate);
+
+
+namespace {
+    const auto document = fostlib::json::parse(
+            R"({"name": "a", "items": [{"n": 1}, {"n": 2}]})");
+
+    f5::json::value patched(const char *patch) {
+        f5::json::validation::changes changed;
+        return f5::json::apply_patch(
+                document, fostlib::json::parse(patch), changed);
+    }
+    bool rejected(const char *patch) {
+        try {
+            patched(patch);
+            return false;
+        } catch (fostlib::exceptions::not_implemented &) { return true; }
+    }
+}
+
+
+FSL_TEST_FUNCTION(patch_operations) {
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "add", "path": "/count", "value": 2}])")
+                    ["count"],
+            fostlib::json(int64_t(2)));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "add", "path": "/items/0", "value": 0}])")
+                    ["items"],
+            fostlib::json::parse(R"([0, {"n": 1}, {"n": 2}])"));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "add", "path": "/items/-", "value": 3}])")
+                    ["items"],
+            fostlib::json::parse(R"([{"n": 1}, {"n": 2}, 3])"));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "remove", "path": "/items/0"}])")["items"],
+            fostlib::json::parse(R"([{"n": 2}])"));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "replace", "path": "", "value": 4}])"),
+            fostlib::json(int64_t(4)));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "move", "from": "/items/1", "path": "/n"}])"),
+            fostlib::json::parse(
+                    R"({"name": "a", "items": [{"n": 1}], "n": {"n": 2}})"));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "copy", "from": "/name", "path": "/b"}])")
+                    ["b"],
+            fostlib::json("a"));
+    FSL_CHECK_EQ(
+            patched(R"([{"op": "test", "path": "/items/1/n", "value": 2}])"),
+            document);
+}
+
+
+FSL_TEST_FUNCTION(patch_changes) {
+    f5::json::validation::changes changed;
+    f5::json::apply_patch(
+            document,
+            fostlib::json::parse(R"([
+                {"op": "replace", "path": "/name", "value": "b"},
+                {"op": "remove", "path": "/items/0"}])"),
+            changed);
+    FSL_CHECK(not changed.unchanged());
+    FSL_CHECK(not changed.everything());
+    const auto &members = changed.changed_members();
+    FSL_CHECK_EQ(members.size(), 2u);
+    FSL_CHECK(members.at("name").everything());
+    /// Removing the first item moves the second one
+    const auto items = members.at("items").changed_items();
+    FSL_CHECK_EQ(items.size(), 2u);
+}
+
+
+/// The error cases from RFC 6902
+FSL_TEST_FUNCTION(patch_errors) {
+    /// A patch is an array of operation objects
+    FSL_CHECK(rejected(R"({"op": "add", "path": "/a", "value": 1})"));
+    FSL_CHECK(rejected(R"([{"path": "/a", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "invent", "path": "/a"}])"));
+    FSL_CHECK(rejected(R"([{"op": "add", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "add", "path": "/a"}])"));
+    FSL_CHECK(rejected(R"([{"op": "replace", "path": "/name"}])"));
+    FSL_CHECK(rejected(R"([{"op": "test", "path": "/name"}])"));
+    FSL_CHECK(rejected(R"([{"op": "copy", "path": "/a"}])"));
+    /// The parent of an added value must exist
+    FSL_CHECK(rejected(R"([{"op": "add", "path": "/x/y", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "add", "path": "/name/y", "value": 1}])"));
+    /// Array indexes
+    FSL_CHECK(rejected(R"([{"op": "add", "path": "/items/3", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "add", "path": "/items/a", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "remove", "path": "/items/-"}])"));
+    FSL_CHECK(rejected(R"([{"op": "remove", "path": "/items/2"}])"));
+    /// The target of remove, replace, move and copy must exist
+    FSL_CHECK(rejected(R"([{"op": "remove", "path": "/x"}])"));
+    FSL_CHECK(rejected(R"([{"op": "replace", "path": "/x", "value": 1}])"));
+    FSL_CHECK(rejected(R"([{"op": "move", "from": "/x", "path": "/y"}])"));
+    FSL_CHECK(rejected(R"([{"op": "copy", "from": "/x", "path": "/y"}])"));
+    /// A value can't be moved into one of its children
+    FSL_CHECK(rejected(
+            R"([{"op": "move", "from": "/items", "path": "/items/0/a"}])"));
+    FSL_CHECK(rejected(R"([{"op": "test", "path": "/name", "value": "b"}])"));
+    FSL_CHECK(rejected(R"([{"op": "test", "path": "/x", "value": null}])"));
+    /// Operations after a failing one don't matter
+    FSL_CHECK(rejected(R"([
+            {"op": "remove", "path": "/x"},
+            {"op": "add", "path": "/y", "value": 1}])"));
+}
+
+
+FSL_TEST_FUNCTION(revalidate_patch) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({"properties": {"name": {
+                    "type": "string"}}})")};
+    auto [after, result] = s.revalidate(
+            document,
+            fostlib::json::parse(
+                    R"([{"op": "replace", "path": "/name", "value": 1}])"));
+    FSL_CHECK_EQ(after["name"], fostlib::json(int64_t(1)));
+    FSL_CHECK(not result);
+}
+
+
+/// Random patches to valid data must give the same outcome with
+/// `revalidate` as with `validate`
+FSL_TEST_FUNCTION(revalidate_random) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "type": "object",
+                "required": ["items"],
+                "additionalProperties": false,
+                "properties": {
+                    "name": {"type": "string", "maxLength": 3},
+                    "count": {"type": "integer"},
+                    "items": {
+                        "type": "array",
+                        "maxItems": 5,
+                        "uniqueItems": true,
+                        "items": {
+                            "type": "object",
+                            "required": ["n"],
+                            "properties": {
+                                "n": {"minimum": 0, "maximum": 9},
+                                "tag": {"enum": ["a", "b"]}}}}}})")};
+    const std::vector<fostlib::string> paths{
+            "/name",    "/count",     "/other",       "/items",
+            "/items/-", "/items/0",   "/items/1",     "/items/2",
+            "/items/0/n", "/items/1/n", "/items/0/tag", "/items/1/tag"};
+    const auto values = fostlib::json::parse(R"([
+            0, 5, 12, -1, "a", "c", "long", null,
+            {"n": 1}, {"n": 2, "tag": "a"}, {"tag": "b"}, {}, []])");
+    const std::vector<fostlib::string> ops{"add", "remove", "replace"};
+
+    std::mt19937 random{42};
+    const auto pick = [&](std::size_t size) {
+        return std::uniform_int_distribution<std::size_t>{0, size - 1}(
+                random);
+    };
+    auto before = fostlib::json::parse(R"({"items": [{"n": 1}, {"n": 2}]})");
+    std::size_t checked{};
+    for (std::size_t n{}; n < 5000; ++n) {
+        f5::json::value::object_t op;
+        op["op"] = ops[pick(ops.size())];
+        op["path"] = paths[pick(paths.size())];
+        op["value"] = values[pick(values.size())];
+        f5::json::value::array_t patch;
+        patch.push_back(op);
+
+        f5::json::validation::changes changed;
+        f5::json::value after;
+        try {
+            after = f5::json::apply_patch(before, patch, changed);
+        } catch (fostlib::exceptions::not_implemented &) { continue; }
+        ++checked;
+        auto full = s.validate(after);
+        auto partial = s.revalidate(after, changed);
+        FSL_CHECK_EQ(bool(partial), bool(full));
+        if (full) {
+            before = after;
+        } else {
+            auto fe = f5::json::validation::result::error(std::move(full));
+            auto pe = f5::json::validation::result::error(std::move(partial));
+            FSL_CHECK_EQ(pe.dpos, fe.dpos);
+        }
+    }
+    FSL_CHECK(checked > 1000u);
+}
@@ -0,0 +1,136 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.compiled.hpp>
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+#include <algorithm>
+
+
+FSL_TEST_SUITE(validator);
+
+
+namespace {
+    /// Each level can be reached through both branches of the `anyOf`,
+    /// so without the memo the work doubles with each level
+    const f5::json::schema nested{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "definitions": {
+                    "t": {
+                        "type": "object",
+                        "properties": {"c": {"$ref": "#/definitions/n"}}},
+                    "n": {"anyOf": [
+                        {"allOf": [
+                            {"$ref": "#/definitions/t"},
+                            {"required": ["zz"]}]},
+                        {"$ref": "#/definitions/t"}]}},
+                "$ref": "#/definitions/n"})")};
+
+    f5::json::value levels(std::size_t depth, f5::json::value leaf) {
+        for (std::size_t n{}; n < depth; ++n) {
+            f5::json::value::object_t level;
+            level["c"] = leaf;
+            leaf = level;
+        }
+        return leaf;
+    }
+}
+
+
+FSL_TEST_FUNCTION(memo_same_outcome) {
+    f5::json::validation::memo memo;
+    const auto good = levels(30, f5::json::value::object_t{});
+    FSL_CHECK(bool(nested.validate(good, memo)));
+    FSL_CHECK(memo.size() > 0u);
+
+    const auto bad = levels(12, f5::json::value{true});
+    auto e = f5::json::validation::result::error(nested.validate(bad, memo));
+    auto plain = f5::json::validation::result::error(nested.validate(bad));
+    FSL_CHECK_EQ(e.assertion, plain.assertion);
+    FSL_CHECK_EQ(e.spos, plain.spos);
+    FSL_CHECK_EQ(e.dpos, plain.dpos);
+
+    memo.clear();
+    FSL_CHECK_EQ(memo.size(), 0u);
+}
+
+
+FSL_TEST_FUNCTION(memo_shared_value) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "definitions": {
+                    "d": {"properties": {"x": {"$ref": "#/definitions/e"}}},
+                    "e": {"required": ["zz"]}},
+                "properties": {
+                    "a": {"not": {"$ref": "#/definitions/d"}},
+                    "b": {"$ref": "#/definitions/d"}}})")};
+    /// The same value is at both `/a` and `/b`, so the outcome for `/a/x`
+    /// is remembered and used again for `/b/x`
+    const auto x = fostlib::json::parse(R"({"x": {}})");
+    f5::json::value::object_t data;
+    data["a"] = x;
+    data["b"] = x;
+
+    f5::json::validation::memo memo;
+    auto e = f5::json::validation::result::error(
+            s.validate(f5::json::value{data}, memo));
+    FSL_CHECK_EQ(e.dpos, (fostlib::jcursor{"b", "x"}));
+    auto plain = f5::json::validation::result::error(
+            s.validate(f5::json::value{data}));
+    FSL_CHECK_EQ(e.dpos, plain.dpos);
+    FSL_CHECK_EQ(e.spos, plain.spos);
+}
+
+
+FSL_TEST_FUNCTION(profile_counts) {
+    const f5::json::schema s{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "type": "object",
+                "properties": {"a": {"minimum": 0}}})")};
+    f5::json::validation::profile p;
+    FSL_CHECK(bool(s.validate(fostlib::json::parse(R"({"a": 1})"), p)));
+    FSL_CHECK(not s.validate(fostlib::json::parse(R"({"a": -1})"), p));
+
+    const auto keywords = p.keywords();
+    FSL_CHECK_EQ(keywords.size(), 3u);
+    FSL_CHECK_EQ(keywords.at("type").calls, 2u);
+    FSL_CHECK_EQ(keywords.at("type").failures, 0u);
+    FSL_CHECK_EQ(keywords.at("properties").calls, 2u);
+    FSL_CHECK_EQ(keywords.at("properties").failures, 1u);
+    FSL_CHECK_EQ(keywords.at("minimum").calls, 2u);
+    FSL_CHECK_EQ(keywords.at("minimum").failures, 1u);
+
+    /// Each sub-schema and each of its keywords has a location
+    const auto locations = p.locations();
+    FSL_CHECK_EQ(locations.size(), 5u);
+    const auto a = std::find_if(
+            locations.begin(), locations.end(), [](const auto &l) {
+                return l.spos == fostlib::jcursor{"properties", "a"}
+                        && not l.keyword.bytes();
+            });
+    FSL_CHECK(a != locations.end());
+    FSL_CHECK_EQ(a->total.calls, 2u);
+
+    const auto &node =
+            s.root().owner->at(fostlib::jcursor{"properties", "a"});
+    const auto minimum = node.find(f5::json::compiled::keyword::minimum);
+    FSL_CHECK_EQ(p.totals(*minimum).calls, 2u);
+    FSL_CHECK_EQ(p.totals(*minimum).failures, 1u);
+
+    p.clear();
+    FSL_CHECK(p.keywords().empty());
+    FSL_CHECK(p.locations().empty());
+    FSL_CHECK_EQ(p.totals(*minimum).calls, 0u);
+    FSL_CHECK(bool(s.validate(fostlib::json::parse(R"({"a": 1})"), p)));
+    FSL_CHECK_EQ(p.keywords().at("minimum").calls, 1u);
+    FSL_CHECK_EQ(p.keywords().at("minimum").failures, 0u);
+}
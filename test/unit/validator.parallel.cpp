@@ -0,0 +1,71 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/schema.hpp>
+
+#include <fost/test>
+
+
+FSL_TEST_SUITE(validator_parallel);
+
+
+namespace {
+    const f5::json::validation::parallel split{4, 10, 3};
+
+    const f5::json::schema small_numbers{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "items": {"maximum": 10},
+                "additionalProperties": {"maximum": 10}})")};
+
+    /// An array of small numbers except for the one at `bad`
+    f5::json::value numbers(std::size_t count, std::size_t bad) {
+        f5::json::value::array_t array;
+        for (std::size_t n{}; n < count; ++n) {
+            array.push_back(int64_t(n == bad ? 20 : 1));
+        }
+        return array;
+    }
+}
+
+
+FSL_TEST_FUNCTION(parallel_array_valid) {
+    FSL_CHECK(bool(small_numbers.validate(numbers(1000, 1000), split)));
+}
+
+
+FSL_TEST_FUNCTION(parallel_array_lowest_error) {
+    for (std::size_t bad : {0, 36, 37, 500, 999}) {
+        const auto array = numbers(1000, bad);
+        auto e = f5::json::validation::result::error(
+                small_numbers.validate(array, split));
+        FSL_CHECK_EQ(e.dpos, fostlib::jcursor{bad});
+        auto single = f5::json::validation::result::error(
+                small_numbers.validate(array));
+        FSL_CHECK_EQ(e.dpos, single.dpos);
+        FSL_CHECK_EQ(e.spos, single.spos);
+    }
+}
+
+
+FSL_TEST_FUNCTION(parallel_object) {
+    f5::json::value::object_t object;
+    for (std::size_t n{}; n < 100; ++n) {
+        object[fostlib::coerce<fostlib::string>(int64_t(n))] = int64_t(n);
+    }
+    /// Every member after "10" is too large
+    auto e = f5::json::validation::result::error(
+            small_numbers.validate(f5::json::value{object}, split));
+    auto single = f5::json::validation::result::error(
+            small_numbers.validate(f5::json::value{object}));
+    FSL_CHECK_EQ(e.dpos, single.dpos);
+}
+
+
+FSL_TEST_FUNCTION(parallel_below_threshold) {
+    FSL_CHECK(not small_numbers.validate(numbers(5, 4), split));
+}
@@ -0,0 +1,97 @@
+/**
+    Copyright 2018-2019 Red Anchor Trading Co. Ltd.
+
+    Distributed under the Boost Software License, Version 1.0.
+    See <http://www.boost.org/LICENSE_1_0.txt>
+ */
+
+#include <f5/json/validator.stream.hpp>
+
+#include <fost/test>
+
+#include <sstream>
+
+
+FSL_TEST_SUITE(validator_stream);
+
+
+namespace {
+    const f5::json::schema person{
+            fostlib::url{},
+            fostlib::json::parse(R"({
+                "type": "object",
+                "required": ["name"],
+                "properties": {
+                    "name": {"type": "string"},
+                    "tags": {"items": {"type": "string"}}}})")};
+
+    f5::json::validation::result check(const char *json) {
+        std::stringstream in{json};
+        return person.validate(static_cast<std::istream &>(in));
+    }
+}
+
+
+FSL_TEST_FUNCTION(stream_events) {
+    f5::json::validation::stream v{person};
+    v.start_object();
+    v.key("name");
+    v.scalar(fostlib::json{"Ann"});
+    FSL_CHECK(not v.complete());
+    FSL_CHECK_EXCEPTION(v.outcome(), fostlib::exceptions::not_implemented &);
+    v.end_object();
+    FSL_CHECK(v.complete());
+    FSL_CHECK(not v.failed());
+    FSL_CHECK(bool(v.outcome()));
+}
+
+
+FSL_TEST_FUNCTION(stream_missing_required) {
+    f5::json::validation::stream v{person};
+    v.start_object();
+    v.key("tags");
+    v.start_array();
+    v.end_array();
+    FSL_CHECK(not v.failed());
+    v.end_object();
+    FSL_CHECK(v.failed());
+    auto e = f5::json::validation::result::error(v.outcome());
+    FSL_CHECK_EQ(e.assertion, "required");
+}
+
+
+FSL_TEST_FUNCTION(stream_fails_early) {
+    f5::json::validation::stream v{person};
+    v.start_object();
+    v.key("tags");
+    v.start_array();
+    v.scalar(fostlib::json{int64_t(1)});
+    /// The error is found before the document is complete
+    FSL_CHECK(v.failed());
+    auto e = f5::json::validation::result::error(v.outcome());
+    FSL_CHECK_EQ(e.assertion, "type");
+    FSL_CHECK_EQ(e.dpos, (fostlib::jcursor{"tags", 0}));
+}
+
+
+FSL_TEST_FUNCTION(stream_parse) {
+    FSL_CHECK(bool(check(R"({"name": "Ann", "tags": ["a", "b"]})")));
+    FSL_CHECK(not check(R"({"name": 1})"));
+    FSL_CHECK(not check(R"([])"));
+    FSL_CHECK(bool(check(R"( {"name": "é", "age": -1.5e-3} )")));
+}
+
+
+FSL_TEST_FUNCTION(stream_parse_errors) {
+    FSL_CHECK_EXCEPTION(
+            check(R"({"name": "Ann")"), fostlib::exceptions::parse_error &);
+    FSL_CHECK_EXCEPTION(
+            check(R"({"name": "Ann", "age": 01})"),
+            fostlib::exceptions::parse_error &);
+    FSL_CHECK_EXCEPTION(
+            check(R"({"name": "Ann", "age": 1.})"),
+            fostlib::exceptions::parse_error &);
+    FSL_CHECK_EXCEPTION(
+            check(R"({"name": "Ann", "age": +1})"),
+            fostlib::exceptions::parse_error &);
+}